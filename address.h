@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Byte address within a device; wide enough for several chips on one bus
+typedef uint32_t address_t;
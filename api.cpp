@@ -1,22 +1,75 @@
 #include "api.h"
 
+#include <Arduino.h>
+
+#include "transaction_trace.h"
+
+
+API::CommandHandler API::handler_for(Command cmd) const
+{
+    auto index = static_cast<byte>(cmd);
+    if (index >= _command_count)
+        return nullptr;
+
+    auto handler = CommandHandler(nullptr);
+    memcpy_P(&handler, _command_table + index, sizeof(handler));
+    return handler;
+}
+
+void API::poll()
+{
+    if (!_ready_sent)
+    {
+        notify_ready();
+        _ready_sent = true;
+    }
+
+    if (!command_available())
+    {
+        idle();
+        return;
+    }
+
+    _ready_sent = false;
+    process_command(read_command());
+    finish_command();
+}
 
 void API::process_command(Command cmd)
 {
-    if (cmd == Command::Unknown)
+#if COMMAND_STATS
+    auto start = micros();
+#endif
+#if TRANSACTION_TRACE
+    transaction_trace.record(TraceOp::CommandStart, static_cast<byte>(cmd), 0u);
+#endif
+
+    auto handler = handler_for(cmd);
+    if (handler == nullptr)
+    {
         this->unknown_command();
-    else if (cmd == Command::WriteFile)
-        this->write_file();
-    else if (cmd == Command::ReadFile)
-        this->read_file();
-    else if (cmd == Command::GetMasterBlock)
-        this->get_master_block();
-    else if (cmd == Command::ListFiles)
-        this->list_files();
-    else if (cmd == Command::RemoveFile)
-        this->remove_file();
-    else if (cmd == Command::Format)
-        this->format();
-    else if (cmd == Command::GetFileName)
-        this->get_filename();
+        cmd = Command::Unknown;
+    }
+    else
+        handler(*this);
+
+#if COMMAND_STATS
+    _command_stats[static_cast<byte>(cmd)].record(micros() - start);
+#endif
+#if TRANSACTION_TRACE
+    transaction_trace.record(TraceOp::CommandEnd, static_cast<byte>(cmd), 0u);
+#endif
+}
+
+#if COMMAND_STATS
+const CommandStats& API::command_stats(Command cmd) const
+{
+    return _command_stats[static_cast<byte>(cmd)];
+}
+
+void API::reset_command_stats()
+{
+    for (auto& stats : _command_stats)
+        stats = CommandStats();
 }
+#endif
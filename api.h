@@ -2,6 +2,13 @@
 
 #include <Arduino.h>
 
+#include "stats.h"
+
+// Override with -DCOMMAND_STATS=1 to time every command in RAM for GetStats
+#ifndef COMMAND_STATS
+#define COMMAND_STATS 0
+#endif
+
 enum class Command : byte
 {
     Unknown = 0u,
@@ -11,26 +18,110 @@ enum class Command : byte
     ListFiles,
     RemoveFile,
     Format,
-    GetFileName
+    GetFileName,
+    GetStats,
+    SetFlowControl,
+    SetBaudRate,
+    DumpImage,
+    RestoreImage,
+    Compact,
+    GetPageWrites,
+    ReadField,
+    DumpTrace,
+    RunBenchmark,
+    SetPipelining,
+
+    // Not a command; keep last so dispatch tables are sized to cover every byte above
+    Count
 };
-        
+
+static constexpr byte command_count = static_cast<byte>(Command::Count);
+
 class API
 {
+    public:
+        typedef void (*CommandHandler)(API&);
+
+        struct CommandRegistration
+        {
+            Command command;
+            CommandHandler handler;
+        };
+
+        template <byte N>
+        struct CommandTable
+        {
+            CommandHandler handlers[N];
+        };
+
+    private:
+        const CommandHandler* _command_table;
+        byte _command_count;
+#if COMMAND_STATS
+        // Ten bytes of RAM per command, so only for boards that can spare it
+        CommandStats _command_stats[command_count];
+#endif
+        bool _ready_sent;
+
+        CommandHandler handler_for(Command cmd) const;
+
     protected:
+        // The table is expected to live in PROGMEM for the lifetime of the API
+        template <byte N>
+        explicit API(const CommandTable<N>& table)
+            : _command_table(table.handlers),
+            _command_count(N),
+#if COMMAND_STATS
+            _command_stats(),
+#endif
+            _ready_sent(false)
+        {
+        }
+
         virtual void unknown_command() = 0;
-        virtual void write_file() = 0;
-        virtual void read_file() = 0;
-        virtual void get_filename() = 0;
-        virtual void get_master_block() = 0;
-        virtual void list_files() = 0;
-        virtual void remove_file() = 0;
-        virtual void format() = 0;
+        // Called by poll() whenever no command is waiting; must return quickly
+        virtual void idle() {}
+        // Called by poll() once a command's handler has returned
+        virtual void finish_command() {}
+
+#if COMMAND_STATS
+        const CommandStats& command_stats(Command cmd) const;
+        void reset_command_stats();
+#endif
 
     public:
         virtual ~API() {}
-        
+
+        // Runs one step of command handling, or one step of idle work when no command is waiting
+        void poll();
         void process_command(Command cmd);
+
+        // Buffers any input that has arrived, without blocking; safe to call while a command runs
+        virtual void receive() = 0;
+        virtual bool command_available() = 0;
         virtual Command read_command() = 0;
         virtual void notify_ready() = 0;
 };
 
+template <typename TApi, void (TApi::*Handler)()>
+void invoke_command(API& api)
+{
+    (static_cast<TApi&>(api).*Handler)();
+}
+
+template <typename TApi, void (TApi::*Handler)()>
+constexpr API::CommandRegistration register_command(Command command)
+{
+    return { command, &invoke_command<TApi, Handler> };
+}
+
+template <byte N = command_count, typename ... TRegistrations>
+constexpr API::CommandTable<N> make_command_table(TRegistrations... registrations)
+{
+    const API::CommandRegistration to_register[] = { registrations... };
+
+    auto table = API::CommandTable<N>{};
+    for (const auto& registration : to_register)
+        table.handlers[static_cast<byte>(registration.command)] = registration.handler;
+    return table;
+}
@@ -0,0 +1,197 @@
+#include "benchmark.h"
+
+#include <Arduino.h>
+#include <utility.h>
+
+#include "char_string.h"
+#include "file.h"
+#include "identifiers.h"
+#include "stream.h"
+
+#ifdef __AVR__
+extern "C" char __heap_start;
+extern "C" char* __brkval;
+#endif
+
+static uint16_t heap_in_use()
+{
+#ifdef __AVR__
+    return (__brkval != nullptr) ? static_cast<uint16_t>(__brkval - &__heap_start) : 0u;
+#else
+    return 0u;
+#endif
+}
+
+static DeviceStats difference(const DeviceStats& after, const DeviceStats& before)
+{
+    auto delta = DeviceStats();
+    delta.transactions = after.transactions - before.transactions;
+    delta.bytes_read = after.bytes_read - before.bytes_read;
+    delta.bytes_written = after.bytes_written - before.bytes_written;
+    delta.write_cycles = after.write_cycles - before.write_cycles;
+    delta.delay_ms = after.delay_ms - before.delay_ms;
+    delta.errors = after.errors - before.errors;
+    return delta;
+}
+
+// Stands in for the handful of accounts a user's credentials are spread over
+static const char* const usernames[] = {
+    "alice@example.com",
+    "alice.work@example.org",
+    "alice",
+    "a.liddell@mail.example.net"
+};
+
+static CharString site_name(uint16_t index)
+{
+    char digits[6];
+    auto length = 0u;
+    do
+    {
+        digits[length++] = static_cast<char>('0' + index % 10u);
+        index /= 10u;
+    } while (index != 0u);
+
+    auto name = CharString("site");
+    auto number = CharString(length);
+    for (auto i = 0u; i < length; i++)
+        number.data()[i] = digits[length - 1u - i];
+    name += number;
+    name += CharString(".example.com");
+    return name;
+}
+
+ostream& operator<<(ostream& stream, const BenchmarkResult& result)
+{
+    return stream << result.operations << result.failures << result.elapsed_us
+        << result.device << result.peak_heap;
+}
+
+uint32_t Benchmark::next_random()
+{
+    // xorshift32
+    _random ^= _random << 13u;
+    _random ^= _random >> 17u;
+    _random ^= _random << 5u;
+    return _random;
+}
+
+void Benchmark::sample_heap()
+{
+    auto heap = heap_in_use();
+    if (heap > _peak_heap)
+        _peak_heap = heap;
+}
+
+File Benchmark::make_file(uint16_t index)
+{
+    static constexpr unsigned int password_length = 16u;
+    auto password = CharString(password_length);
+    for (auto i = 0u; i < password_length; i++)
+        password.data()[i] = static_cast<char>('!' + next_random() % 94u);
+
+    return File(
+        site_name(index),
+        CharString(usernames[index % (sizeof(usernames) / sizeof(usernames[0]))]),
+        std::move(password));
+}
+
+BenchmarkResult Benchmark::run(Workload workload, uint16_t count)
+{
+    auto result = BenchmarkResult();
+    auto before = DeviceStats(_fs.device_stats());
+    _peak_heap = 0u;
+    sample_heap();
+
+    auto started = micros();
+    if (workload == Workload::Import)
+        import(count, result);
+    else if (workload == Workload::Lookup)
+        lookup(count, result);
+    else if (workload == Workload::Churn)
+        churn(count, result);
+    else if (workload == Workload::List)
+        list(count, result);
+    else if (workload == Workload::Format)
+        format(count, result);
+    result.elapsed_us = micros() - started;
+
+    result.device = difference(_fs.device_stats(), before);
+    result.peak_heap = _peak_heap;
+    return result;
+}
+
+void Benchmark::import(uint16_t count, BenchmarkResult& result)
+{
+    // Continue the numbering, so repeated imports add new names
+    auto first = static_cast<uint16_t>(_fs.count_files());
+    for (auto i = 0u; i < count; i++, result.operations++)
+    {
+        _fs.write(make_file(static_cast<uint16_t>(first + i)))
+            .match([](auto&&) {}, [&](auto&&) { result.failures++; });
+        sample_heap();
+    }
+}
+
+void Benchmark::lookup(uint16_t count, BenchmarkResult& result)
+{
+    auto files = _fs.count_files();
+    for (auto i = 0u; i < count && files > 0u; i++, result.operations++)
+    {
+        _fs.read(site_name(static_cast<uint16_t>(next_random() % files)))
+            .match([](auto&&) {}, [&](auto&&) { result.failures++; });
+        sample_heap();
+    }
+}
+
+void Benchmark::churn(uint16_t count, BenchmarkResult& result)
+{
+    auto ids = _fs.list_files();
+    for (auto i = 0u; i < count && !ids.empty(); i++, result.operations++)
+    {
+        auto position = ids.begin() + next_random() % ids.size();
+        auto name = CharString();
+        auto named = false;
+        _fs.get_filename(*position).match(
+            [&](auto&& filename) { name = std::move(filename); named = true; },
+            [](auto&&) {});
+        if (!named)
+        {
+            result.failures++;
+            ids.erase(position);
+            continue;
+        }
+
+        auto file = make_file(0u);
+        file.name = std::move(name);
+        _fs.remove(*position);
+        _fs.write(file)
+            .match(
+                [&](auto&& new_id) { *position = new_id; },
+                [&](auto&&) {
+                    result.failures++;
+                    ids.erase(position);
+                });
+        sample_heap();
+    }
+}
+
+void Benchmark::list(uint16_t count, BenchmarkResult& result)
+{
+    for (auto i = 0u; i < count; i++, result.operations++)
+    {
+        _fs.list_files();
+        sample_heap();
+    }
+}
+
+void Benchmark::format(uint16_t count, BenchmarkResult& result)
+{
+    for (auto i = 0u; i < count; i++, result.operations++)
+    {
+        auto encryption_iv = CharString(_fs.get_master_block().encryption_iv);
+        auto challenge = CharString(_fs.get_master_block().challenge);
+        _fs.format(encryption_iv, challenge);
+        sample_heap();
+    }
+}
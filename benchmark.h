@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "file.h"
+#include "file_system.h"
+#include "stats.h"
+#include "stream.h"
+
+// Override with -DBENCHMARK_COMMAND=1 to add RunBenchmark, which writes, removes and
+// formats files on the device
+#ifndef BENCHMARK_COMMAND
+#define BENCHMARK_COMMAND 0
+#endif
+
+enum class Workload : uint8_t
+{
+    // Writes count new credentials
+    Import = 0u,
+    // Reads count credentials by name, picked at random from site0.example.com up to
+    // the file count. Only meaningful on a device filled by Import from empty; any name
+    // that is missing counts as a failure.
+    Lookup,
+    // Removes count files at random, writing each back with a new password. Works on
+    // any files; one that cannot be written back is dropped from the run.
+    Churn,
+    // Lists the files count times
+    List,
+    // Formats the device count times, keeping its encryption IV and challenge
+    Format,
+
+    // Not a workload; keep last
+    Count
+};
+
+struct BenchmarkResult
+{
+    uint16_t operations;
+    uint16_t failures;
+    uint32_t elapsed_us;
+    DeviceStats device;
+    // Largest heap seen between operations; 0 where the heap cannot be measured
+    uint16_t peak_heap;
+
+    BenchmarkResult()
+        : operations(0u),
+        failures(0u),
+        elapsed_us(0u),
+        device(),
+        peak_heap(0u)
+    {}
+};
+
+ostream& operator<<(ostream& stream, const BenchmarkResult& result);
+
+// Scripted workloads measured on the device itself. Credentials are generated from the
+// seed, so a run can be repeated exactly on a freshly formatted device.
+class Benchmark
+{
+    private:
+        FileSystem& _fs;
+        uint32_t _random;
+        uint16_t _peak_heap;
+
+        uint32_t next_random();
+        void sample_heap();
+        File make_file(uint16_t index);
+
+        void import(uint16_t count, BenchmarkResult& result);
+        void lookup(uint16_t count, BenchmarkResult& result);
+        void churn(uint16_t count, BenchmarkResult& result);
+        void list(uint16_t count, BenchmarkResult& result);
+        void format(uint16_t count, BenchmarkResult& result);
+
+    public:
+        Benchmark(FileSystem& fs, uint32_t seed)
+            : _fs(fs),
+            _random((seed != 0u) ? seed : 1u),
+            _peak_heap(0u)
+        {}
+
+        BenchmarkResult run(Workload workload, uint16_t count);
+};
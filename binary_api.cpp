@@ -1,10 +1,38 @@
 #include "binary_api.h"
 
+#include "benchmark.h"
+#include "crc32.h"
 #include "identifiers.h"
+#include "inode.h"
 #include "stream.h"
+#include "transaction_trace.h"
 
 #include <utility.h>
 
+const API::CommandTable<command_count> BinaryAPI::command_table PROGMEM = make_command_table(
+    register_command<BinaryAPI, &BinaryAPI::write_file>(Command::WriteFile),
+    register_command<BinaryAPI, &BinaryAPI::read_file>(Command::ReadFile),
+    register_command<BinaryAPI, &BinaryAPI::get_master_block>(Command::GetMasterBlock),
+    register_command<BinaryAPI, &BinaryAPI::list_files>(Command::ListFiles),
+    register_command<BinaryAPI, &BinaryAPI::remove_file>(Command::RemoveFile),
+    register_command<BinaryAPI, &BinaryAPI::format>(Command::Format),
+    register_command<BinaryAPI, &BinaryAPI::get_filename>(Command::GetFileName),
+    register_command<BinaryAPI, &BinaryAPI::get_stats>(Command::GetStats),
+    register_command<BinaryAPI, &BinaryAPI::set_flow_control>(Command::SetFlowControl),
+    register_command<BinaryAPI, &BinaryAPI::set_baud_rate>(Command::SetBaudRate),
+    register_command<BinaryAPI, &BinaryAPI::dump_image>(Command::DumpImage),
+    register_command<BinaryAPI, &BinaryAPI::restore_image>(Command::RestoreImage),
+    register_command<BinaryAPI, &BinaryAPI::compact>(Command::Compact),
+    register_command<BinaryAPI, &BinaryAPI::get_page_writes>(Command::GetPageWrites),
+    register_command<BinaryAPI, &BinaryAPI::read_field>(Command::ReadField),
+    register_command<BinaryAPI, &BinaryAPI::dump_trace>(Command::DumpTrace),
+    register_command<BinaryAPI, &BinaryAPI::run_benchmark>(Command::RunBenchmark),
+    register_command<BinaryAPI, &BinaryAPI::set_pipelining>(Command::SetPipelining)
+);
+
+static_assert(static_cast<char>(CommandStatus::Credit) == SerialStream::credit_grant,
+    "Flow control grants must be distinguishable from response status bytes");
+
 CommandStatus BinaryAPI::convert_error(FileSystemError error) const
 {
     if (error == FileSystemError::NotEnoughDiskSpace)
@@ -16,16 +44,93 @@ CommandStatus BinaryAPI::convert_error(FileSystemError error) const
 
 void BinaryAPI::notify_ready()
 {
+    // Pipelined hosts send without waiting, so there is nothing to announce
+    if (_pipelined)
+        return;
+
+    _sstream.reset_credit();
     _output.put(static_cast<byte>(CommandStatus::Ready));
 }
 
+void BinaryAPI::receive()
+{
+    _sstream.receive();
+}
+
+bool BinaryAPI::command_available()
+{
+    return _sstream.available() > 0u;
+}
+
 Command BinaryAPI::read_command()
 {
-    notify_ready();
+    if (_pipelined)
+    {
+        auto tag = static_cast<byte>(_input.get());
+        _input >> _request_length;
+        _request_start = _input.tellg();
+        _sstream.limit_reads(_request_start + _request_length);
+        _framed = true;
+        _output.put(tag);
+    }
+
+    // An empty frame reads as 0, Command::Unknown
     auto command = static_cast<byte>(_input.get());
     return static_cast<Command>(command);
 }
 
+void BinaryAPI::finish_command()
+{
+    _last_command_ms = millis();
+    if (!_fs->master_clean())
+        _scheduler.wake(_flush_task);
+
+    // Checked rather than _pipelined, which SetPipelining may just have changed
+    if (!_framed)
+        return;
+
+    // Skip whatever the handler left unread, such as the arguments of an unknown command,
+    // so the next request starts where its frame does
+    while (_input.tellg() - _request_start < _request_length)
+        _input.get();
+    _sstream.limit_reads(SerialStream::no_read_limit);
+    _framed = false;
+}
+
+bool BinaryAPI::arguments_complete()
+{
+    if (!_sstream.overran())
+        return true;
+
+    _output.put(static_cast<byte>(CommandStatus::Fail));
+    return false;
+}
+
+bool BinaryAPI::request_holds(uint32_t size) const
+{
+    return !_pipelined || _input.tellg() - _request_start + size <= _request_length;
+}
+
+void BinaryAPI::idle()
+{
+    _scheduler.run_once();
+}
+
+bool BinaryAPI::reclaim_in_background()
+{
+    return _fs->reclaim_idle_step();
+}
+
+bool BinaryAPI::flush_in_background()
+{
+    // Reclaiming changes the counts again, so the flush waits for it
+    if (millis() - _last_command_ms < master_flush_delay_ms || _scheduler.pending(_reclaim_task))
+        return true;
+
+    _fs->flush_master_block();
+    return false;
+}
+
 void BinaryAPI::unknown_command()
 {
     _output.put(static_cast<byte>(CommandStatus::Fail));
@@ -35,6 +140,9 @@ void BinaryAPI::write_file()
 {
     File file;
     _input >> file;
+    if (!arguments_complete())
+        return;
+
     _fs->write(file)
         .match(
             [&](auto&&) { _output.put(static_cast<byte>(CommandStatus::OK)); },
@@ -46,6 +154,9 @@ void BinaryAPI::read_file()
 {
     CharString filename;
     _input >> filename;
+    if (!arguments_complete())
+        return;
+
     _fs->read(filename)
         .match(
             [&](auto&& file) {
@@ -56,10 +167,36 @@ void BinaryAPI::read_file()
         );
 }
 
+void BinaryAPI::read_field()
+{
+    FileId id;
+    _input >> id;
+    auto field = static_cast<FileField>(_input.get());
+    if (!arguments_complete())
+        return;
+    if (field >= FileField::Count)
+    {
+        _output.put(static_cast<byte>(CommandStatus::Fail));
+        return;
+    }
+
+    _fs->read_field(id, field)
+        .match(
+            [&](auto&& value) {
+                _output.put(static_cast<byte>(CommandStatus::OK));
+                _output << value;
+            },
+            [&](auto&& error) { _output.put(static_cast<byte>(convert_error(error))); }
+        );
+}
+
 void BinaryAPI::get_filename()
 {
     FileId id;
     _input >> id;
+    if (!arguments_complete())
+        return;
+
     _fs->get_filename(id)
         .match(
             [&] (auto&& filename) {
@@ -88,9 +225,15 @@ void BinaryAPI::remove_file()
 {
     FileId fileId;
     _input >> fileId;
+    if (!arguments_complete())
+        return;
+
     _fs->remove(fileId)
         .match(
-            [&](auto&&) { _output.put(static_cast<byte>(CommandStatus::OK)); },
+            [&](auto&&) {
+                _output.put(static_cast<byte>(CommandStatus::OK));
+                _scheduler.wake(_reclaim_task);
+            },
             [&](auto&& error) { _output.put(static_cast<byte>(convert_error(error))); }
         );
 }
@@ -99,6 +242,330 @@ void BinaryAPI::format()
 {
     CharString encryption_iv, challenge;
     _input >> encryption_iv >> challenge;
+    if (!arguments_complete())
+        return;
+
     _fs->format(std::move(encryption_iv), std::move(challenge));
     _output.put(static_cast<byte>(CommandStatus::OK));
 }
+
+void BinaryAPI::get_stats()
+{
+    auto option = static_cast<StatsOption>(_input.get());
+    if (!arguments_complete())
+        return;
+
+    _output.put(static_cast<byte>(CommandStatus::OK));
+    _output << _fs->device_stats() << _sstream.stats() << _fs->stats();
+#if COMMAND_STATS
+    _output.put(static_cast<byte>(command_count));
+    for (auto index = 0u; index < command_count; index++)
+        _output << command_stats(static_cast<Command>(index));
+#else
+    _output.put(static_cast<byte>(0u));
+#endif
+
+    if (option == StatsOption::ReadAndReset)
+    {
+        _fs->reset_stats();
+        _sstream.reset_stats();
+#if COMMAND_STATS
+        reset_command_stats();
+#endif
+    }
+}
+
+void BinaryAPI::set_flow_control()
+{
+    auto enabled = _input.get() != 0;
+    if (!arguments_complete())
+        return;
+
+    // Credit grants would land in the middle of pipelined responses
+    if (enabled && _pipelined)
+    {
+        _output.put(static_cast<byte>(CommandStatus::Fail));
+        return;
+    }
+
+    _output.put(static_cast<byte>(CommandStatus::OK));
+    _output << SerialStream::receive_buffer_size << SerialStream::credit_size;
+    _sstream.set_flow_control(enabled);
+}
+
+void BinaryAPI::set_pipelining()
+{
+    auto enabled = _input.get() != 0;
+    if (!arguments_complete())
+        return;
+
+    // A pipelined host keeps the bytes of its unanswered requests within the receive
+    // buffer; each response means its whole request has been consumed
+    _output.put(static_cast<byte>(CommandStatus::OK));
+    _output << SerialStream::receive_buffer_size;
+
+    if (enabled)
+        _sstream.set_flow_control(false);
+    _pipelined = enabled;
+}
+
+void BinaryAPI::set_baud_rate()
+{
+    uint32_t baud_rate = 0u;
+    _input >> baud_rate;
+    if (!arguments_complete())
+        return;
+
+    if (!SerialStream::supports_baud_rate(baud_rate))
+    {
+        _output.put(static_cast<byte>(CommandStatus::Fail));
+        return;
+    }
+
+    // OK goes out at the old rate; the host then switches and proves the new
+    // link works by sending the confirmation byte, which is answered at the new rate
+    _output.put(static_cast<byte>(CommandStatus::OK));
+
+    auto previous_baud_rate = _sstream.baud_rate();
+    _sstream.set_baud_rate(baud_rate);
+
+    if (_sstream.expect(baud_rate_confirmation, baud_rate_timeout_ms))
+        _output.put(static_cast<byte>(CommandStatus::OK));
+    else
+        _sstream.set_baud_rate(previous_baud_rate);
+}
+
+void BinaryAPI::dump_image()
+{
+    auto mode = static_cast<ImageMode>(_input.get());
+    if (!arguments_complete())
+        return;
+    if (mode == ImageMode::UsedInodes)
+    {
+        dump_used_inodes();
+        return;
+    }
+
+    uint32_t address = 0u, length = 0u;
+    _input >> address >> length;
+    if (!arguments_complete())
+        return;
+
+    // A length of zero dumps everything from address to the end of the device
+    auto image_size = _fs->image_size();
+    if (mode != ImageMode::Range || address > image_size || length > image_size - address)
+    {
+        _output.put(static_cast<byte>(CommandStatus::Fail));
+        return;
+    }
+    if (length == 0u)
+        length = image_size - address;
+
+    _output.put(static_cast<byte>(CommandStatus::OK));
+    _output << length;
+
+    auto checksum = CRC32();
+    for (auto offset = 0ul; offset < length;)
+    {
+        auto remaining = length - offset;
+        auto chunk = static_cast<uint16_t>((remaining < image_chunk_size) ? remaining : image_chunk_size);
+        auto data = _fs->read_image(address + offset, chunk);
+        checksum.update(data.data(), chunk);
+        _output.write(data.data(), chunk);
+        offset += chunk;
+    }
+
+    _output << checksum.value();
+}
+
+void BinaryAPI::dump_used_inodes()
+{
+    _output.put(static_cast<byte>(CommandStatus::OK));
+
+    auto checksum = CRC32();
+    auto inode_count = _fs->inode_count();
+    for (auto inode = inode_t(0u); inode < inode_count; inode++)
+    {
+        if (inode != 0u && !_fs->inode_in_use(inode))
+            continue;
+
+        auto data = _fs->read_image(static_cast<address_t>(inode) * INODE_SIZE, INODE_SIZE);
+        checksum.update(reinterpret_cast<const char*>(&inode), sizeof(inode));
+        checksum.update(data.data(), INODE_SIZE);
+        _output << inode;
+        _output.write(data.data(), INODE_SIZE);
+    }
+
+    _output << end_of_inodes << checksum.value();
+}
+
+void BinaryAPI::restore_image()
+{
+    uint32_t address = 0u, length = 0u;
+    _input >> address >> length;
+
+    // Whole pages only, so every page is written in a single write cycle. An invalid
+    // request is still read to the end so its data is not taken for further commands.
+    auto image_size = _fs->image_size();
+    auto valid = (address % image_chunk_size) == 0u
+        && (length % image_chunk_size) == 0u
+        && address <= image_size
+        && length <= image_size - address;
+
+    // A pipelined frame must carry the whole image and its checksum before the master block
+    // is cleared; otherwise finish_command() skips the rest of the frame
+    if (_pipelined && !(valid && !_sstream.overran() && request_holds(length + sizeof(uint32_t))))
+    {
+        _output.put(static_cast<byte>(CommandStatus::Fail));
+        return;
+    }
+
+    // When the range covers it, the master inode is held back until the checksum proves the
+    // whole image arrived. Until then the device carries an empty master block, so a corrupted
+    // or cut short restore mounts as a device with no files rather than as whatever was
+    // received. A range past the master block leaves it and the files it describes alone.
+    auto restores_master = valid && address < INODE_SIZE && length > 0u;
+    auto master = CharString();
+    if (restores_master)
+    {
+        master = _fs->read_image(0u, INODE_SIZE);
+        _fs->clear_master_block();
+    }
+
+    auto checksum = CRC32();
+    auto page = CharString(static_cast<unsigned int>(image_chunk_size));
+    for (auto offset = 0ul; offset < length;)
+    {
+        auto remaining = length - offset;
+        auto chunk = static_cast<uint16_t>((remaining < image_chunk_size) ? remaining : image_chunk_size);
+        _input.read(page.data(), chunk);
+        checksum.update(page.data(), chunk);
+        if (valid)
+            restore_page(address + offset, page, master);
+        offset += chunk;
+    }
+
+    uint32_t expected_checksum = 0u;
+    _input >> expected_checksum;
+
+    auto status = (valid && checksum.value() == expected_checksum) ? CommandStatus::OK : CommandStatus::Fail;
+    if (status == CommandStatus::OK && restores_master)
+        _fs->write_image(0u, master);
+    if (valid)
+        _fs->remount();
+
+    _output.put(static_cast<byte>(status));
+}
+
+void BinaryAPI::restore_page(address_t address, const CharString& page, CharString& master)
+{
+    if (address >= INODE_SIZE)
+    {
+        _fs->write_image(address, page);
+        return;
+    }
+
+    auto master_bytes = (page.length() < INODE_SIZE - address) ? page.length() : INODE_SIZE - address;
+    memcpy(master.data() + address, page.data(), master_bytes);
+    if (master_bytes < page.length())
+        _fs->write_image(address + master_bytes, page.read(master_bytes, page.length() - master_bytes));
+}
+
+void BinaryAPI::compact()
+{
+    uint16_t max_steps = 0u;
+    _input >> max_steps;
+    if (!arguments_complete())
+        return;
+
+    // Moving a file header renumbers its FileId, so compaction only runs when the host asks
+    // for it; a budget of zero just reports whether the last compaction is still complete
+    if (max_steps == 0u)
+    {
+        _output.put(static_cast<byte>(CommandStatus::OK));
+        _output.put(static_cast<byte>(_fs->compacted()));
+        return;
+    }
+
+    // Each step moves at most one inode, so the host bounds how long the reply takes
+    auto progress = CompactProgress::Running;
+    auto status = CommandStatus::OK;
+    for (auto step = 0u; step < max_steps && progress == CompactProgress::Running && status == CommandStatus::OK; step++)
+    {
+        _fs->compact_step()
+            .match(
+                [&](auto&& result) { progress = result; },
+                [&](auto&& error) { status = convert_error(error); }
+            );
+    }
+
+    _output.put(static_cast<byte>(status));
+    _output.put(static_cast<byte>(progress == CompactProgress::Complete));
+}
+
+void BinaryAPI::get_page_writes()
+{
+    uint16_t first_page = 0u, page_count = 0u;
+    _input >> first_page >> page_count;
+    if (!arguments_complete())
+        return;
+
+#if PAGE_WRITE_COUNTERS
+    auto pages = _fs->image_size() / EEPROM::page_size;
+    if (first_page > pages || page_count > pages - first_page)
+    {
+        _output.put(static_cast<byte>(CommandStatus::Fail));
+        return;
+    }
+
+    _output.put(static_cast<byte>(CommandStatus::OK));
+    _output << EEPROM::page_size;
+    for (auto page = 0ul; page < page_count; page++)
+        _output << _fs->page_writes((first_page + page) * EEPROM::page_size);
+#else
+    _output.put(static_cast<byte>(CommandStatus::Fail));
+#endif
+}
+
+void BinaryAPI::dump_trace()
+{
+#if TRANSACTION_TRACE
+    transaction_trace.suspend(true);
+
+    auto count = transaction_trace.size();
+    _output.put(static_cast<byte>(CommandStatus::OK));
+    _output << count << transaction_trace.dropped();
+    for (auto i = 0u; i < count; i++)
+        _output << transaction_trace.pop();
+
+    transaction_trace.clear();
+    transaction_trace.suspend(false);
+#else
+    _output.put(static_cast<byte>(CommandStatus::Fail));
+#endif
+}
+
+void BinaryAPI::run_benchmark()
+{
+    auto workload = static_cast<Workload>(_input.get());
+    uint16_t count = 0u;
+    uint32_t seed = 0u;
+    _input >> count >> seed;
+    if (!arguments_complete())
+        return;
+
+#if BENCHMARK_COMMAND
+    if (workload >= Workload::Count)
+    {
+        _output.put(static_cast<byte>(CommandStatus::Fail));
+        return;
+    }
+
+    auto result = Benchmark(*_fs, seed).run(workload, count);
+    _output.put(static_cast<byte>(CommandStatus::OK));
+    _output << result;
+#else
+    (void) workload;
+    _output.put(static_cast<byte>(CommandStatus::Fail));
+#endif
+}
@@ -4,48 +4,127 @@
 
 #include "api.h"
 #include "file_system.h"
+#include "idle_scheduler.h"
 #include "serial_stream.h"
 #include "stream.h"
 #include "eeprom.h"
 
+enum class StatsOption : byte
+{
+    Read = 0u,
+    ReadAndReset
+};
+
+enum class ImageMode : byte
+{
+    // Raw bytes of an address range
+    Range = 0u,
+    // The master block and every inode in use, each preceded by its inode number
+    UsedInodes
+};
+
 enum class CommandStatus : byte
 {
     OK = 0u,
     Fail,
     NotEnoughDiskSpace,
     FileNotFound,
-    Ready
+    Ready,
+    Credit
 };
 
 class BinaryAPI : public API
 {
     private:
+        static constexpr char baud_rate_confirmation = 0x55;
+        static constexpr unsigned long baud_rate_timeout_ms = 1000ul;
+        // Restores arrive and are written one page at a time, so only a page is ever buffered
+        static constexpr uint16_t image_chunk_size = EEPROM::page_size;
+        static constexpr inode_t end_of_inodes = 0xFFFFu;
+
         std::unique_ptr<FileSystem> _fs;
         SerialStream _sstream;
         istream _input;
         ostream _output;
+        IdleScheduler _scheduler;
+        IdleScheduler::TaskId _reclaim_task;
+        IdleScheduler::TaskId _flush_task;
+        // The master block is flushed only once the host has been quiet this long, so a burst
+        // of commands costs it one write to mark it dirty and one to mark it clean again
+        static constexpr unsigned long master_flush_delay_ms = 2000ul;
+        unsigned long _last_command_ms;
+        // In pipelined mode every request is framed as a u8 tag and u16 length followed by
+        // the command and its arguments, and every response starts with the request's tag.
+        // Requests longer than the u16 frame allows, such as large image restores, are sent
+        // with pipelining switched off.
+        bool _pipelined;
+        // Set while handling a framed request, which SetPipelining may outlive
+        bool _framed;
+        address_t _request_start;
+        uint16_t _request_length;
+
+        bool reclaim_in_background();
+        bool flush_in_background();
 
     protected:
+        static const CommandTable<command_count> command_table;
+
         void unknown_command() override;
-        void write_file() override;
-        void read_file() override;
-        void get_filename() override;
-        void get_master_block() override;
-        void list_files() override;
-        void remove_file() override;
-        void format() override;
+        void idle() override;
+        void finish_command() override;
+        void write_file();
+        void read_file();
+        void read_field();
+        void get_filename();
+        void get_master_block();
+        void list_files();
+        void remove_file();
+        void format();
+        void get_stats();
+        void set_flow_control();
+        void set_baud_rate();
+        void dump_image();
+        void dump_used_inodes();
+        void restore_image();
+        // Writes one received page, keeping any part of the master inode in master instead
+        void restore_page(address_t address, const CharString& page, CharString& master);
+        void compact();
+        void get_page_writes();
+        void dump_trace();
+        void run_benchmark();
+        void set_pipelining();
 
         CommandStatus convert_error(FileSystemError error) const;
+        // Answers Fail if the arguments just read ran past a pipelined request's frame;
+        // handlers call it before acting on them
+        bool arguments_complete();
+        // Whether size more bytes fit in the current pipelined request's frame
+        bool request_holds(uint32_t size) const;
 
     public:
         BinaryAPI()
-            : _fs(std::make_unique<FileSystem>(std::make_unique<EEPROM>())),
+            : API(command_table),
+            _fs(std::make_unique<FileSystem>(std::make_unique<EEPROM>())),
             _sstream(),
             _input(&_sstream),
-            _output(&_sstream)
+            _output(&_sstream),
+            _scheduler(),
+            _reclaim_task(_scheduler.add(invoke_task<BinaryAPI, &BinaryAPI::reclaim_in_background>, this)),
+            _flush_task(_scheduler.add(invoke_task<BinaryAPI, &BinaryAPI::flush_in_background>, this)),
+            _last_command_ms(millis()),
+            _pipelined(false),
+            _framed(false),
+            _request_start(0u),
+            _request_length(0u)
         {
+            // Files removed before a restart may still hold their chains, and a mount after an
+            // unclean shutdown leaves the master block to be flushed
+            _scheduler.wake(_reclaim_task);
+            _scheduler.wake(_flush_task);
         }
 
+        void receive() override;
+        bool command_available() override;
         Command read_command() override;
         void notify_ready() override;
 };
@@ -1,5 +1,4 @@
 #include <Arduino.h>
-#include <Wire.h>
 #include <memory.h>
 
 #include "file_system.h"
@@ -8,6 +7,8 @@
 
 #include "api.h"
 #include "binary_api.h"
+#include "serial_stream.h"
+#include "twi.h"
 
 std::unique_ptr<API> _api;
 
@@ -15,19 +16,25 @@ void setup()
 {
     pinMode(2, OUTPUT);
     pinMode(3, OUTPUT);
-    Wire.begin();
-    Wire.setClock(400000);
+    TWI::begin(I2C_CLOCK);
 
     digitalWrite(2, HIGH);
-    Serial.begin(115200);
+    Serial.begin(SerialStream::default_baud_rate);
     while (!Serial) {}
 
     _api = std::make_unique<BinaryAPI>();
     digitalWrite(2, LOW);
 }
 
+// Called by the core and by the EEPROM drivers while they wait, so serial input
+// keeps being drained while a page write is in progress
+void yield()
+{
+    if (_api)
+        _api->receive();
+}
+
 void loop()
 {
-    auto command = _api->read_command();
-    _api->process_command(command);
+    _api->poll();
 }
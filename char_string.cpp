@@ -5,7 +5,6 @@
 #include <memory.h>
 #include <utility.h>
 
-#include "size.h"
 #include "stream.h"
 
 
@@ -106,7 +105,12 @@ char* CharString::data() const
 
 unsigned int CharString::size() const
 {
-    return ::size(_size) + _size;
+    return sizeof(length_prefix_t) + _size;
+}
+
+unsigned int CharString::length() const
+{
+    return _size;
 }
 
 bool CharString::operator==(const CharString& other) const
@@ -136,12 +140,12 @@ CharString& CharString::operator+=(const CharString& other)
     return *this;
 }
 
-void CharString::write(unsigned short address, const char* data, unsigned long size)
+void CharString::write(address_t address, const char* data, unsigned long size)
 {
     memcpy(_data + address, data, size);
 }
 
-CharString CharString::read(unsigned short address, unsigned long tsize) const
+CharString CharString::read(address_t address, unsigned long tsize) const
 {
     auto result = CharString(static_cast<unsigned int>(tsize));
     memcpy(result._data, _data + address, tsize);
@@ -150,15 +154,16 @@ CharString CharString::read(unsigned short address, unsigned long tsize) const
 
 ostream& operator<<(ostream& stream, const CharString& string)
 {
-    stream << string._size;
+    stream << static_cast<CharString::length_prefix_t>(string._size);
     stream.write(string._data, string._size);
     return stream;
 }
 
 istream& operator>>(istream& stream, CharString& string)
 {
-    string._size = 0u;
-    stream >> string._size;
+    auto size = CharString::length_prefix_t(0u);
+    stream >> size;
+    string._size = size;
 
     string._data = (char*) realloc(string._data, string._size);
 
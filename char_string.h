@@ -15,6 +15,9 @@ class CharString : public IWriteable, public IReadable
         unsigned int get_string_size(const char* other) const;
 
     public:
+        // Serialized lengths take 16 bits on every target, as unsigned int does on the AVR
+        typedef uint16_t length_prefix_t;
+
         CharString();
         explicit CharString(unsigned int tsize);
         explicit CharString(unsigned long tsize);
@@ -34,7 +37,7 @@ class CharString : public IWriteable, public IReadable
             _data = (char*) realloc(_data, sizeof(T));
             _size = sizeof(T);
             for (auto i = 0u; i < sizeof(T); i++)
-                _data[i] = (value >> (i * sizeof(char))) & 0xFF;
+                _data[i] = static_cast<char>((value >> (i * 8u)) & 0xFF);
         }
 
         ~CharString();
@@ -42,21 +45,23 @@ class CharString : public IWriteable, public IReadable
         template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
         static T as_integral(const char* data)
         {
-            T out;
+            T out = 0;
             for (auto i = 0u; i < sizeof(T); i++)
-                out |= (data[i] << (i * sizeof(char)));
+                out |= static_cast<T>(static_cast<T>(static_cast<uint8_t>(data[i])) << (i * 8u));
             return out;
         }
 
         char* data() const;
         unsigned int size() const;
+        // Number of characters, without the serialized length prefix counted by size()
+        unsigned int length() const;
 
         bool operator==(const CharString&) const;
         bool operator!=(const CharString& other) const;
         CharString& operator+=(const CharString& other);
 
-        void write(unsigned short address, const char* data, unsigned long size) override;
-        CharString read(unsigned short address, unsigned long size) const override;
+        void write(address_t address, const char* data, unsigned long size) override;
+        CharString read(address_t address, unsigned long size) const override;
         
         friend ostream& operator<<(ostream& stream, const CharString& string);
         friend istream& operator>>(istream& stream, CharString& string);
@@ -0,0 +1,33 @@
+#include "crc32.h"
+
+#include <Arduino.h>
+
+// One nibble at a time keeps the table small enough to leave in flash
+static const uint32_t crc32_nibble_table[16] PROGMEM = {
+    0x00000000ul, 0x1DB71064ul, 0x3B6E20C8ul, 0x26D930ACul,
+    0x76DC4190ul, 0x6B6B51F4ul, 0x4DB26158ul, 0x5005713Cul,
+    0xEDB88320ul, 0xF00F9344ul, 0xD6D6A3E8ul, 0xCB61B38Cul,
+    0x9B64C2B0ul, 0x86D3D2D4ul, 0xA00AE278ul, 0xBDBDF21Cul
+};
+
+static uint32_t crc32_nibble(uint32_t crc)
+{
+    uint32_t entry;
+    memcpy_P(&entry, &crc32_nibble_table[crc & 0x0Fu], sizeof(entry));
+    return (crc >> 4) ^ entry;
+}
+
+void CRC32::update(const char* data, unsigned long size)
+{
+    for (auto i = 0ul; i < size; i++)
+    {
+        _crc ^= static_cast<uint8_t>(data[i]);
+        _crc = crc32_nibble(_crc);
+        _crc = crc32_nibble(_crc);
+    }
+}
+
+uint32_t CRC32::value() const
+{
+    return _crc ^ 0xFFFFFFFFul;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <Arduino.h>
+
+// CRC-32 (IEEE 802.3, as used by zlib) so hosts can check transfers with a stock library
+class CRC32
+{
+    private:
+        uint32_t _crc;
+
+    public:
+        CRC32()
+            : _crc(0xFFFFFFFFul)
+        {}
+
+        void update(const char* data, unsigned long size);
+        uint32_t value() const;
+};
@@ -1,6 +1,25 @@
 #pragma once
 
-#include "24lc16b.h"
-#include "24lc512.h"
+// Host builds pass EEPROM_DEVICE and EEPROM_DEVICE_HEADER to put any class with the
+// drivers' interface under the file system, such as host/mapped_image.h
+#ifdef EEPROM_DEVICE
+#include EEPROM_DEVICE_HEADER
+typedef EEPROM_DEVICE EEPROM;
+#else
 
-typedef EEPROM_16kb EEPROM;
+#include "eeprom_array.h"
+#include "i2c_eeprom.h"
+
+// Build with EEPROM_PART=<one of the EEPROM_24LC* profiles> for other parts
+#ifndef EEPROM_PART
+#define EEPROM_PART EEPROM_24LC512
+#endif
+
+// Build with EEPROM_CHIPS=n to stripe the filesystem across n chips
+#if defined(EEPROM_CHIPS) && EEPROM_CHIPS > 1
+typedef EEPROM_Array<EEPROM_PART, EEPROM_CHIPS> EEPROM;
+#else
+typedef EEPROM_PART EEPROM;
+#endif
+
+#endif
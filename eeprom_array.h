@@ -0,0 +1,144 @@
+#pragma once
+
+#include <Arduino.h>
+#include <memory.h>
+
+#include "char_string.h"
+#include "readable.h"
+#include "stats.h"
+#include "writeable.h"
+
+enum class EEPROMLayout : uint8_t
+{
+    // Chip n holds addresses [n * capacity, (n + 1) * capacity)
+    Concatenated = 0u,
+    // Consecutive pages rotate across the chips, so sequential page writes
+    // land on a chip that is not still busy with the previous write cycle
+    Striped
+};
+
+template <typename TChip, uint8_t ChipCount, EEPROMLayout Layout = EEPROMLayout::Striped>
+class EEPROM_Array : public IReadable, public IWriteable
+{
+    static_assert(ChipCount > 0u && ChipCount <= TChip::max_chips, "Not enough chip select pins");
+
+    private:
+        struct Location
+        {
+            uint8_t chip;
+            address_t address;
+            unsigned long contiguous_bytes;
+        };
+
+        std::unique_ptr<TChip> _chips[ChipCount];
+        mutable DeviceStats _stats;
+
+        static Location locate(address_t address)
+        {
+            if (Layout == EEPROMLayout::Concatenated)
+            {
+                auto offset = address % TChip::capacity;
+                return {
+                    static_cast<uint8_t>(address / TChip::capacity),
+                    offset,
+                    TChip::capacity - offset
+                };
+            }
+
+            auto page = address / TChip::page_size;
+            auto offset = address % TChip::page_size;
+            return {
+                static_cast<uint8_t>(page % ChipCount),
+                (page / ChipCount) * TChip::page_size + offset,
+                TChip::page_size - offset
+            };
+        }
+
+    public:
+        static constexpr uint16_t page_size = TChip::page_size;
+        static constexpr uint32_t capacity = TChip::capacity * ChipCount;
+
+        const uint32_t size = capacity;
+
+        EEPROM_Array()
+            : _stats()
+        {
+            for (auto chip = 0u; chip < ChipCount; chip++)
+                _chips[chip] = std::make_unique<TChip>(static_cast<uint8_t>(chip));
+        }
+
+        ~EEPROM_Array() {}
+
+        bool busy() const
+        {
+            for (const auto& chip : _chips)
+                if (chip->busy())
+                    return true;
+            return false;
+        }
+
+        void write(address_t address, const char* data, unsigned long size) override
+        {
+            for (auto i = 0ul; i < size;)
+            {
+                auto location = locate(address + i);
+                auto remaining = size - i;
+                auto to_write = (remaining < location.contiguous_bytes) ? remaining : location.contiguous_bytes;
+                _chips[location.chip]->write(location.address, data + i, to_write);
+                i += to_write;
+            }
+        }
+
+        CharString read(address_t address, unsigned long size) const override
+        {
+            auto result = CharString(size);
+            auto* out = result.data();
+
+            for (auto i = 0ul; i < size;)
+            {
+                auto location = locate(address + i);
+                auto remaining = size - i;
+                auto to_read = (remaining < location.contiguous_bytes) ? remaining : location.contiguous_bytes;
+                _chips[location.chip]->read(location.address, out + i, to_read);
+                i += to_read;
+            }
+
+            return result;
+        }
+
+        uint16_t page_writes(address_t address) const
+        {
+            auto location = locate(address);
+            return _chips[location.chip]->page_writes(location.address);
+        }
+
+        const DeviceStats& stats() const
+        {
+            _stats = DeviceStats();
+            for (const auto& chip : _chips)
+            {
+                const auto& chip_stats = chip->stats();
+                _stats.transactions += chip_stats.transactions;
+                _stats.bytes_read += chip_stats.bytes_read;
+                _stats.bytes_written += chip_stats.bytes_written;
+                _stats.write_cycles += chip_stats.write_cycles;
+                _stats.delay_ms += chip_stats.delay_ms;
+                _stats.errors += chip_stats.errors;
+            }
+            return _stats;
+        }
+
+        bool take_failure()
+        {
+            auto failed = false;
+            for (auto& chip : _chips)
+                failed = chip->take_failure() || failed;
+            return failed;
+        }
+
+        void reset_stats()
+        {
+            for (auto& chip : _chips)
+                chip->reset_stats();
+        }
+};
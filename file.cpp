@@ -1,6 +1,11 @@
 #include "file.h"
 #include "size.h"
 
+File File::clone() const
+{
+    return File(CharString(name), CharString(username), CharString(password));
+}
+
 unsigned int File::size() const
 {
     return ::size(name) + ::size(username) + ::size(password);
@@ -27,6 +27,8 @@ struct File
     File& operator=(const File&) = delete;
     File& operator=(File&&) = default;
 
+    // Explicit deep copy; implicit copies are disabled to keep heap use visible
+    File clone() const;
     unsigned int size() const;
 };
 
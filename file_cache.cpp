@@ -0,0 +1,106 @@
+#include "file_cache.h"
+
+#include <utility.h>
+
+#include "char_string.h"
+#include "file.h"
+#include "identifiers.h"
+
+uint16_t FileCache::hash(const CharString& name)
+{
+    // 16 bit FNV-1a folded from the 32 bit variant
+    uint32_t hash = 2166136261ul;
+    const auto* data = name.data();
+    for (auto i = 0u; i < name.length(); i++)
+    {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 16777619ul;
+    }
+    return static_cast<uint16_t>((hash >> 16) ^ (hash & 0xFFFFu));
+}
+
+FileCache::Entry* FileCache::touch(Entry& entry)
+{
+    entry.last_used = ++_clock;
+    return &entry;
+}
+
+FileCache::Entry& FileCache::victim()
+{
+    auto* oldest = &_entries[0];
+    for (auto& entry : _entries)
+    {
+        if (entry.id.value == 0u)
+            return entry;
+        if (static_cast<uint16_t>(_clock - entry.last_used) > static_cast<uint16_t>(_clock - oldest->last_used))
+            oldest = &entry;
+    }
+    return *oldest;
+}
+
+const File* FileCache::find(const FileId& id)
+{
+    for (auto& entry : _entries)
+    {
+        if (entry.id.value != 0u && entry.id.value == id.value)
+            return &touch(entry)->file;
+    }
+    return nullptr;
+}
+
+const File* FileCache::find(const CharString& name, uint16_t name_hash, FileId& id)
+{
+    for (auto& entry : _entries)
+    {
+        if (entry.id.value != 0u && entry.name_hash == name_hash && entry.file.name == name)
+        {
+            id = entry.id;
+            return &touch(entry)->file;
+        }
+    }
+    return nullptr;
+}
+
+void FileCache::insert(const FileId& id, const File& file)
+{
+    invalidate(id);
+
+    auto& entry = victim();
+    entry.id = id;
+    entry.name_hash = hash(file.name);
+    entry.file = file.clone();
+    touch(entry);
+}
+
+void FileCache::invalidate(const FileId& id)
+{
+    for (auto& entry : _entries)
+    {
+        if (entry.id.value == id.value)
+        {
+            entry.id = FileId();
+            entry.file = File();
+        }
+    }
+}
+
+void FileCache::invalidate(uint16_t name_hash)
+{
+    for (auto& entry : _entries)
+    {
+        if (entry.id.value != 0u && entry.name_hash == name_hash)
+        {
+            entry.id = FileId();
+            entry.file = File();
+        }
+    }
+}
+
+void FileCache::clear()
+{
+    for (auto& entry : _entries)
+    {
+        entry.id = FileId();
+        entry.file = File();
+    }
+}
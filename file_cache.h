@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "char_string.h"
+#include "file.h"
+#include "identifiers.h"
+
+// Override with -DFILE_CACHE_SIZE=n; every entry holds a whole decoded record in RAM
+#ifndef FILE_CACHE_SIZE
+#if defined(__AVR_ATmega1284P__) || defined(__AVR_ATmega1284__)
+#define FILE_CACHE_SIZE 8
+#else
+#define FILE_CACHE_SIZE 2
+#endif
+#endif
+
+class FileCache
+{
+    private:
+        struct Entry
+        {
+            FileId id;
+            uint16_t name_hash;
+            uint16_t last_used;
+            File file;
+
+            Entry() : id(), name_hash(0u), last_used(0u), file() {}
+        };
+
+        Entry _entries[FILE_CACHE_SIZE];
+        uint16_t _clock;
+
+        Entry* touch(Entry& entry);
+        Entry& victim();
+
+    public:
+        FileCache()
+            : _entries(),
+            _clock(0u)
+        {}
+
+        static uint16_t hash(const CharString& name);
+
+        // nullptr on a miss
+        const File* find(const FileId& id);
+        const File* find(const CharString& name, uint16_t name_hash, FileId& id);
+
+        void insert(const FileId& id, const File& file);
+        void invalidate(const FileId& id);
+        void invalidate(uint16_t name_hash);
+        void clear();
+};
@@ -0,0 +1,105 @@
+#include "file_record.h"
+
+#include "char_string.h"
+#include "record_compression.h"
+#include "size.h"
+#include "stream.h"
+
+#include <utility.h>
+
+uint16_t FieldTable::length(FileField field) const
+{
+    return entries[static_cast<uint8_t>(field)] & length_mask;
+}
+
+bool FieldTable::compressed(FileField field) const
+{
+    return (entries[static_cast<uint8_t>(field)] & compressed_bit) != 0u;
+}
+
+bool FieldTable::shared(FileField field) const
+{
+    return (entries[static_cast<uint8_t>(field)] & shared_bit) != 0u;
+}
+
+unsigned int FieldTable::offset(FileField field) const
+{
+    auto offset = size;
+    for (auto index = 0u; index < static_cast<uint8_t>(field); index++)
+        offset += entries[index] & length_mask;
+    return offset;
+}
+
+unsigned int FieldTable::record_length() const
+{
+    return offset(FileField::Count);
+}
+
+bool read_field_table(const CharString& record, FieldTable& table)
+{
+    if (record.length() < FieldTable::size)
+        return false;
+
+    auto header = record.read(0u, FieldTable::size);
+    auto reader = istream(&header);
+    auto marker = uint16_t(0u);
+    reader >> marker;
+    if (marker != FieldTable::marker)
+        return false;
+
+    for (auto& entry : table.entries)
+        reader >> entry;
+    return true;
+}
+
+CharString encode_field(const CharString& value, uint16_t& entry)
+{
+    entry = static_cast<uint16_t>(value.length());
+#if RECORD_COMPRESSION
+    auto packed = compress_record(value);
+    if (packed.length() < value.length())
+    {
+        entry = static_cast<uint16_t>(packed.length()) | FieldTable::compressed_bit;
+        return packed;
+    }
+#endif
+    return CharString(value);
+}
+
+CharString encode_record(const File& file, inode_t username_reference)
+{
+    auto table = FieldTable();
+    CharString stored[file_field_count];
+
+    stored[0] = encode_field(file.name, table.entries[0]);
+    if (username_reference != 0u)
+    {
+        stored[1] = CharString(static_cast<unsigned int>(sizeof(username_reference)));
+        auto reference_writer = ostream(&stored[1]);
+        reference_writer << username_reference;
+        table.entries[1] = static_cast<uint16_t>(sizeof(username_reference)) | FieldTable::shared_bit;
+    }
+    else
+        stored[1] = encode_field(file.username, table.entries[1]);
+    stored[2] = encode_field(file.password, table.entries[2]);
+
+    for (const auto& field : stored)
+        if (field.length() > FieldTable::length_mask)
+            return CharString();
+
+    auto record = CharString(static_cast<unsigned int>(table.record_length()));
+    auto writer = ostream(&record);
+    writer << FieldTable::marker;
+    for (auto entry : table.entries)
+        writer << entry;
+    for (const auto& field : stored)
+        writer.write(field.data(), field.length());
+    return record;
+}
+
+CharString decode_field(const FieldTable& table, FileField field, const CharString& stored)
+{
+    if (table.compressed(field))
+        return expand_record(stored);
+    return CharString(stored);
+}
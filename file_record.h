@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "char_string.h"
+#include "file.h"
+#include "inode.h"
+
+enum class FileField : uint8_t
+{
+    Name = 0u,
+    Username,
+    Password,
+
+    // Not a field; keep last
+    Count
+};
+
+static constexpr uint8_t file_field_count = static_cast<uint8_t>(FileField::Count);
+
+// Records open with a table of one 16 bit entry per field, after a marker no older
+// record can start with, so any one field can be found from the header inode alone:
+//   ffff  name entry  username entry  password entry  name  username  password
+// An entry holds the stored length, and its top bits mark a field stored through
+// compress_record() or a username held in the string table as an inode number.
+struct FieldTable
+{
+    static constexpr uint16_t marker = 0xFFFFu;
+    static constexpr uint16_t compressed_bit = 0x8000u;
+    static constexpr uint16_t shared_bit = 0x4000u;
+    static constexpr uint16_t length_mask = 0x3FFFu;
+    static constexpr unsigned int size = sizeof(marker) + file_field_count * sizeof(uint16_t);
+
+    uint16_t entries[file_field_count];
+
+    FieldTable() : entries() {}
+
+    uint16_t length(FileField field) const;
+    bool compressed(FileField field) const;
+    bool shared(FileField field) const;
+    // Offset of the stored field from the start of the record
+    unsigned int offset(FileField field) const;
+    unsigned int record_length() const;
+};
+
+// Returns false for a record written before the field table, or one too short for its table
+bool read_field_table(const CharString& record, FieldTable& table);
+// A field as encode_record() stores it, setting its table entry
+CharString encode_field(const CharString& value, uint16_t& entry);
+// Compresses each field that gets shorter, unless built with RECORD_COMPRESSION=0.
+// A non-zero username_reference replaces the username.
+CharString encode_record(const File& file, inode_t username_reference);
+// Expands a stored field; shared usernames come back as their stored inode number
+CharString decode_field(const FieldTable& table, FileField field, const CharString& stored);
@@ -2,8 +2,10 @@
 
 #include "char_string.h"
 #include "file.h"
+#include "file_record.h"
 #include "identifiers.h"
 #include "inode.h"
+#include "shared_string.h"
 #include "size.h"
 #include "stream.h"
 #include "vector.h"
@@ -14,14 +16,25 @@
 #include <utility.h>
 
 
-unsigned int inode_to_address(unsigned int inode_number)
+static address_t inode_to_address(inode_t inode_number)
 {
-    return inode_number * INODE_SIZE;
+    return static_cast<address_t>(inode_number) * INODE_SIZE;
 }
 
-unsigned int address_to_inode(unsigned int address)
+static address_t references_address(inode_t shared_string)
 {
-    return address / INODE_SIZE;
+    return inode_to_address(shared_string) + InodeHeaderLayout::size;
+}
+
+static address_t inode_data_address(inode_t inode_number)
+{
+    return inode_to_address(inode_number) + InodeHeaderLayout::size + sizeof(CharString::length_prefix_t);
+}
+
+// A reference takes as much room as a two byte username, and an entry must fit one inode
+static bool shareable(const CharString& username)
+{
+    return username.length() > sizeof(inode_t) && username.length() <= max_shared_string_length;
 }
 
 size_t FileSystem::count_free_space()
@@ -42,87 +55,414 @@ const FSMasterBlock& FileSystem::get_master_block() const
 
 void FileSystem::format(const CharString& encryption_iv, const CharString& challenge)
 {
-    auto total_inodes = _eeprom->size / INODE_SIZE;
+    auto total_inodes = _inode_count;
     for (auto index = 1u; index < total_inodes; index++)
-        free_inode(inode_to_address(index));
+        free_inode(index);
 
+    _cache.clear();
     _master_block = FSMasterBlock(total_inodes - 1u, 0u, encryption_iv, challenge);
+    _master_clean = true;
     write_master_block();
     delay(50);
     sync_usage_record();
+    // Nothing is stored, so the empty index is already complete
+    _usernames.clear(true);
+}
+
+bool FileSystem::device_failed()
+{
+    return _eeprom->take_failure();
 }
 
 void FileSystem::write_master_block()
 {
-    _ostream.seekg(0);
-    _ostream << FSMasterINode(0u, false, _master_block);
+    write_master_inode(FSMasterINode(0u, false, _master_block));
+}
+
+void FileSystem::write_master_inode(const FSMasterINode& inode)
+{
+    // One device write, so the counts, the state and any journal entry land together
+    auto state = FSMasterState(_allocation_cursor, _master_clean);
+    auto image = CharString(static_cast<unsigned int>(::size(inode) + ::size(state)));
+    auto writer = ostream(&image);
+    writer << inode << state;
+    write_image(0u, image);
+}
+
+void FileSystem::mark_dirty()
+{
+    if (!_master_clean)
+        return;
+
+    _master_clean = false;
+    write_master_block();
+}
+
+void FileSystem::flush_master_block()
+{
+    if (_master_clean)
+        return;
+
+    _master_clean = true;
+    write_master_block();
+}
+
+bool FileSystem::master_clean() const
+{
+    return _master_clean;
 }
 
 void FileSystem::sync_usage_record()
 {
     _istream.seekg(0);
     auto inode = FSMasterINode();
-    _istream >> inode;
+    auto state = FSMasterState();
+    _istream >> inode >> state;
     _master_block = std::move(inode.data);
+    restart_compaction();
+    _recount_target = 1u;
+    _usernames.clear(false);
+    _reclaim_pending = true;
+    _reclaim_rescan = true;
+
+    // Version 0 images have no state, just whatever followed their strings
+    auto current = inode.flags.in_use && inode.flags.version == inode_format_version;
+    auto cursor = state.allocation_cursor;
+    _allocation_cursor = (current && cursor > 0u && cursor < _inode_count) ? cursor : inode_t(1u);
+    _master_clean = current && state.clean;
+
+    if (inode.flags.in_use && inode.flags.version < inode_format_version)
+        upgrade_format();
+    else if (inode.flags.relocating)
+        finish_relocation(inode.next);
+    else if (inode.flags.reclaiming)
+    {
+        // Reclaim entries are left open, so the header may since have been freed and reused
+        auto header = read_inode_header(inode.next);
+        if (header.flags.in_use && header.flags.reclaiming)
+        {
+            // Looked up while the record is still whole, as reclaim_file() does
+            auto username_reference = find_username_reference(inode.next);
+            reclaim_chain(inode.next);
+            if (username_reference != 0u)
+                release_shared_string(username_reference);
+        }
+        write_master_block();
+    }
+
+    if (current && !_master_clean)
+    {
+        free_orphans();
+        recount_usage();
+    }
 }
 
-either<FileId, FileSystemError> FileSystem::write(const File& file)
+void FileSystem::free_orphans()
 {
-    auto file_size = size(file);
+    // Each pass starts at the first member the last one could not cover, so passes are
+    // only spent on windows that hold chain members
+    auto first = inode_t(1u);
+    while (first < _inode_count)
+    {
+        uint8_t members[orphan_window / 8u] = {};
+        uint8_t referenced[orphan_window / 8u] = {};
+        auto next_first = _inode_count;
+        for (auto index = inode_t(1u); index < _inode_count; index++)
+        {
+            auto header = read_inode_header(index);
+            if (!header.flags.in_use)
+                continue;
 
-    if (file_size > count_free_space())
-        return FileSystemError::NotEnoughDiskSpace;
+            if (header.next >= first && header.next - first < orphan_window)
+                referenced[(header.next - first) / 8u] |= static_cast<uint8_t>(1u << ((header.next - first) % 8u));
+
+            // Removed headers and string table entries are not referred to by anything
+            if (index < first || header.flags.is_file_header || header.flags.reclaiming || is_shared_string(header.flags))
+                continue;
+            if (index - first < orphan_window)
+                members[(index - first) / 8u] |= static_cast<uint8_t>(1u << ((index - first) % 8u));
+            else if (index < next_first)
+                next_first = index;
+        }
+
+        for (auto offset = inode_t(0u); offset < orphan_window && first + offset < _inode_count; offset++)
+        {
+            auto bit = static_cast<uint8_t>(1u << (offset % 8u));
+            if (!(members[offset / 8u] & bit) || (referenced[offset / 8u] & bit))
+                continue;
 
-    auto to_write = write_file_to_string(file);
-    auto inode_address = request_free_inode();
-    auto fileId = FileId(address_to_inode(inode_address));
+            // The write went out tail first, so the members below this one are orphans too.
+            // Each keeps its next, as in reclaim_chain().
+            auto orphan = inode_t(first + offset);
+            for (auto steps = 0u; orphan != 0u && steps < _inode_count; steps++)
+            {
+                auto member = read_inode_header(orphan);
+                if (!member.flags.in_use || member.flags.is_file_header || member.flags.reclaiming
+                    || is_shared_string(member.flags))
+                    break;
 
-    auto max_size = ::size(to_write);
-    for (auto i = 0u; i < max_size;)
+                auto freed = INode<void>();
+                freed.next = member.next;
+                set_inode_header(orphan, freed);
+                orphan = member.next;
+            }
+        }
+        first = next_first;
+    }
+}
+
+void FileSystem::recount_usage()
+{
+    // Writes, removes and shared string releases leave the counts to the next master block
+    // write, so after a restart they are stale; a header pass on mount puts them right
+    auto free_inodes = uint32_t(0u);
+    auto file_headers = uint32_t(0u);
+    for (auto index = inode_t(1u); index < _inode_count; index++)
     {
-        auto bytes_remaining = ::size(to_write) - i;
-        auto bytes_to_write = (bytes_remaining < usable_inode_space - sizeof(unsigned int))
-            ? bytes_remaining
-            : usable_inode_space - sizeof(unsigned int);
-        auto next_address = (bytes_remaining > bytes_to_write) ? request_free_inode() : 0u;
+        auto header = read_inode_header(index);
+        if (!header.flags.in_use)
+            free_inodes++;
+        else if (header.flags.is_file_header)
+            file_headers++;
+    }
 
-        write_inode(inode_address, next_address, i, bytes_to_write, to_write);
+    if (free_inodes == _master_block.free_inodes && file_headers == _master_block.file_headers)
+        return;
+
+    _master_block.free_inodes = free_inodes;
+    _master_block.file_headers = file_headers;
+    write_master_block();
+}
 
-        inode_address = next_address;
-        i += bytes_to_write;
+void FileSystem::upgrade_format()
+{
+    auto version_0_inodes = static_cast<inode_t>(
+        ((_eeprom->size < version_0_max_bytes) ? _eeprom->size : version_0_max_bytes) / INODE_SIZE);
+
+    for (auto index = 1u; index < version_0_inodes; index++)
+    {
+        auto header = read_inode_header(index);
+        if (!header.flags.in_use || header.flags.version != 0u)
+            continue;
+
+        header.next = static_cast<inode_t>(header.next / INODE_SIZE);
+        header.flags.version = inode_format_version;
+        _ostream.seekg(inode_to_address(index));
+        _ostream << header;
     }
 
+    // Storage beyond 64 KB was never formatted by version 0 and becomes usable now
+    for (auto index = version_0_inodes; index < _inode_count; index++)
+    {
+        _ostream.seekg(inode_to_address(index));
+        _ostream << INode<void>();
+    }
+    _master_block.free_inodes += _inode_count - version_0_inodes;
+
     write_master_block();
+}
+
+either<FileId, FileSystemError> FileSystem::write(const File& file)
+{
+    device_failed();
+    mark_dirty();
+#if SHARED_USERNAMES
+    auto username_reference = acquire_shared_string(file.username);
+#else
+    auto username_reference = inode_t(0u);
+#endif
+    auto to_write = encode_record(file, username_reference);
+    auto max_size = to_write.length();
+
+    // Removed files only count as free space once their chains are reclaimed
+    while (max_size > count_free_space() && reclaim_step()) {}
+
+    auto inode_data_size = usable_inode_space - sizeof(CharString::length_prefix_t);
+
+    // Claim the whole chain in one read-only scan so the page writes below go
+    // out back to back, each overlapping the previous chip write cycle
+    auto inodes = (max_size == 0u || max_size > count_free_space())
+        ? vector<inode_t>()
+        : request_free_inodes((max_size + inode_data_size - 1u) / inode_data_size);
+    if (inodes.empty())
+    {
+        if (username_reference != 0u)
+            release_shared_string(username_reference);
+        return FileSystemError::NotEnoughDiskSpace;
+    }
+
+    auto fileId = FileId(inodes[0]);
+    restart_compaction();
+    // The new file may take a lower inode than a cached namesake and so shadow it
+    _cache.invalidate(FileCache::hash(file.name));
+
+    // The claimed inodes stay free on the device until written, so the chain goes out tail
+    // first and the header last; a restart part way through leaves the members already
+    // written for free_orphans(), but never leaves a header pointing at free inodes
+    for (auto inode = inodes.size(); inode-- > 0u;)
+    {
+        auto start_index = inode * inode_data_size;
+        auto bytes_remaining = max_size - start_index;
+        auto bytes_to_write = (bytes_remaining < inode_data_size) ? bytes_remaining : inode_data_size;
+        auto next = (inode + 1u < inodes.size()) ? inodes[inode + 1u] : inode_t(0u);
+
+        write_inode(inodes[inode], next, start_index, bytes_to_write, to_write);
+    }
+
+    if (device_failed())
+        return FileSystemError::DeviceError;
+
+#if SHARED_USERNAMES
+    // The first record to use a username keeps it inline, where the next one finds it
+    if (username_reference == 0u && _usernames.built() && shareable(file.username))
+        _usernames.insert(FileCache::hash(file.username), fileId.value, false);
+#endif
     return fileId;
 }
 
-CharString FileSystem::write_file_to_string(const File& file) const
+inode_t FileSystem::acquire_shared_string(const CharString& value)
+{
+    if (!shareable(value))
+        return 0u;
+
+    // Only a username a second record shares earns an entry; the first record keeps its
+    // inline copy, so a username used once costs no inode
+    auto shared = false;
+    auto existing = find_username(value, shared);
+    if (existing == 0u)
+        return 0u;
+
+    if (shared)
+    {
+        auto references = read_shared_string(existing).data.references;
+        if (references == 0xFFFFu)
+            return 0u;
+
+        _ostream.seekg(references_address(existing));
+        _ostream << static_cast<uint16_t>(references + 1u);
+        return existing;
+    }
+
+    auto inodes = request_free_inodes(1u);
+    if (inodes.empty())
+        return 0u;
+
+    auto entry = SharedStringINode(0u, false, SharedString(1u, CharString(value)));
+    entry.flags.shared_string = 1u;
+
+    // One device write, so a torn entry is never taken for a valid one
+    auto image = CharString(static_cast<unsigned int>(::size(entry)));
+    auto writer = ostream(&image);
+    writer << entry;
+    write_image(inode_to_address(inodes[0]), image);
+    _usernames.insert(FileCache::hash(value), inodes[0], true);
+    return inodes[0];
+}
+
+void FileSystem::release_shared_string(inode_t inode)
 {
-    auto file_size = size(file);
-    auto to_write = CharString(file_size);
-    auto writer = ostream(std::addressof(to_write));
-    writer << file;
-    return to_write;
+    if (!is_shared_string(read_inode_header(inode).flags))
+        return;
+
+    auto references = read_shared_string(inode).data.references;
+    if (references > 1u)
+    {
+        _ostream.seekg(references_address(inode));
+        _ostream << static_cast<uint16_t>(references - 1u);
+        return;
+    }
+
+    set_inode_header(inode, INode<void>());
+    _master_block.free_inodes++;
+    _usernames.remove(inode);
+}
+
+void FileSystem::index_usernames()
+{
+    _usernames.clear(true);
+    for (auto index = inode_t(1u); index < _inode_count; index++)
+    {
+        auto header = read_inode_header(index);
+        if (is_shared_string(header.flags))
+            _usernames.insert(FileCache::hash(read_shared_string(index).data.value), index, true);
+        else if (header.flags.in_use && header.flags.is_file_header)
+        {
+            auto username = inline_username(index, read_file_inode(index));
+            if (shareable(username))
+                _usernames.insert(FileCache::hash(username), index, false);
+        }
+    }
+}
+
+inode_t FileSystem::find_username(const CharString& value, bool& shared)
+{
+    if (!_usernames.built())
+        index_usernames();
+
+    const auto* entry = _usernames.find(FileCache::hash(value));
+    if (entry == nullptr)
+        return 0u;
+
+    // The hash may collide and the inode may have changed hands, so the device has the last word
+    auto inode = entry->inode;
+    shared = entry->shared;
+    auto found = false;
+    if (shared)
+        found = is_shared_string(read_inode_header(inode).flags) && read_shared_string(inode).data.value == value;
+    else
+    {
+        auto header_inode = read_file_inode(inode);
+        found = header_inode.flags.in_use && header_inode.flags.is_file_header
+            && inline_username(inode, header_inode) == value;
+    }
+
+    if (!found)
+    {
+        _usernames.remove(inode);
+        return 0u;
+    }
+    return inode;
+}
+
+CharString FileSystem::inline_username(inode_t header, const INode<CharString>& header_inode)
+{
+    auto table = FieldTable();
+    auto stored = CharString();
+    if (read_stored_field(header, header_inode, FileField::Username, table, stored))
+        return table.shared(FileField::Username) ? CharString() : decode_field(table, FileField::Username, stored);
+
+    // Records written before the field table always hold the username inline
+    return std::move(read_inode_to_file(header).username);
+}
+
+SharedStringINode FileSystem::read_shared_string(inode_t inode)
+{
+    _istream.seekg(inode_to_address(inode));
+    auto entry = SharedStringINode();
+    _istream >> entry;
+    return entry;
 }
 
 void FileSystem::write_inode(
-        unsigned int inode_address,
-        unsigned int next_address,
+        inode_t inode,
+        inode_t next,
         unsigned int start_index,
         unsigned int bytes_to_write,
         const CharString& to_write)
 {
-    _ostream.seekg(inode_address);
-
     auto data_to_write = to_write.read(start_index, bytes_to_write);
     bool is_file_header = start_index == 0u;
 
     auto inode_to_write = INode<CharString>(
-        next_address,
+        next,
         is_file_header,
         std::move(data_to_write));
 
-    _ostream << inode_to_write;
+    // One device write for the header and data together
+    auto image = CharString(static_cast<unsigned int>(::size(inode_to_write)));
+    auto writer = ostream(&image);
+    writer << inode_to_write;
+    write_image(inode_to_address(inode), image);
 
     if (is_file_header)
         _master_block.file_headers++;
@@ -130,15 +470,34 @@ void FileSystem::write_inode(
 
 either<File, FileSystemError> FileSystem::read(const FileId& fileId)
 {
-    auto address = inode_to_address(fileId.value);
-    auto header = read_inode_header(address);
+    if (const auto* cached = _cache.find(fileId))
+    {
+        _stats.cache_hits++;
+        return cached->clone();
+    }
+    _stats.cache_misses++;
+
+    device_failed();
+    auto header = read_inode_header(fileId.value);
     if (!header.flags.is_file_header)
-        return FileSystemError::FileNotFound;
-    return read_address_to_file(address);
+        return device_failed() ? FileSystemError::DeviceError : FileSystemError::FileNotFound;
+
+    auto file = read_inode_to_file(fileId.value);
+    if (device_failed())
+        return FileSystemError::DeviceError;
+    _cache.insert(fileId, file);
+    return file;
 }
 
 either<File, FileSystemError> FileSystem::read(const CharString& filename)
 {
+    auto file_id = FileId();
+    if (const auto* cached = _cache.find(filename, FileCache::hash(filename), file_id))
+    {
+        _stats.cache_hits++;
+        return cached->clone();
+    }
+
     return get_fileid_by_filename(filename)
         .foldFirst([&] (auto&& file_id) { return read(file_id); });
 }
@@ -146,12 +505,12 @@ either<File, FileSystemError> FileSystem::read(const CharString& filename)
 either<FileId, FileSystemError> FileSystem::get_fileid_by_filename(const CharString& filename)
 {
     auto file_count = static_cast<unsigned int>(count_files());
-    auto file_address = 0u;
+    auto file_inode = inode_t(0u);
     auto file_id = FileId(0u);
 
     for (auto i = 0u; i < file_count && file_id.value == 0u; i++)
     {
-        get_next_file_header(file_address)
+        get_next_file_header(file_inode)
             .match(
                 [&](const auto& current_file_id) -> void
                 {
@@ -162,7 +521,7 @@ either<FileId, FileSystemError> FileSystem::get_fileid_by_filename(const CharStr
                                 if (current_filename == filename) { file_id = current_file_id; }
                             },
                             [] (const auto&) { });
-                    file_address = inode_to_address(current_file_id.value) + INODE_SIZE;
+                    file_inode = current_file_id.value + 1u;
                 },
                 [] (const auto&) {});
     }
@@ -175,23 +534,162 @@ either<FileId, FileSystemError> FileSystem::get_fileid_by_filename(const CharStr
 
 either<CharString, FileSystemError> FileSystem::get_filename(const FileId& fileId)
 {
-    return read(fileId)
-        .mapFirst([] (const auto& file) { return file.name; });
+    if (const auto* cached = _cache.find(fileId))
+        return CharString(cached->name);
+
+    // Filename scans visit every file, so they bypass the cache rather than flush it
+    return read_field(fileId, FileField::Name);
 }
 
-File FileSystem::read_address_to_file(unsigned int address)
+either<CharString, FileSystemError> FileSystem::read_field(const FileId& fileId, FileField field)
 {
-    auto file_data = read_file_to_string(address);
-    auto file_stream = istream(&file_data);
+    if (field >= FileField::Count)
+        return FileSystemError::FileNotFound;
+
+    if (const auto* cached = _cache.find(fileId))
+    {
+        _stats.cache_hits++;
+        return CharString(
+            (field == FileField::Name) ? cached->name
+            : (field == FileField::Username) ? cached->username
+            : cached->password);
+    }
+
+    device_failed();
+    auto header = read_file_inode(fileId.value);
+    if (!header.flags.is_file_header)
+        return device_failed() ? FileSystemError::DeviceError : FileSystemError::FileNotFound;
+
+    auto table = FieldTable();
+    auto stored = CharString();
+    auto value = CharString();
+    if (read_stored_field(fileId.value, header, field, table, stored))
+        value = field_value(table, field, stored);
+    else
+    {
+        auto file = read_inode_to_file(fileId.value);
+        value = std::move((field == FileField::Name) ? file.name
+            : (field == FileField::Username) ? file.username
+            : file.password);
+    }
+
+    if (device_failed())
+        return FileSystemError::DeviceError;
+    return value;
+}
+
+bool FileSystem::read_stored_field(
+        inode_t header,
+        const INode<CharString>& header_inode,
+        FileField field,
+        FieldTable& table,
+        CharString& stored)
+{
+    if (!read_field_table(header_inode.data, table))
+        return false;
+
+    // Every inode but the last in a chain is full, so the offset alone says which inode holds
+    // each byte; the inodes before the field only need their next pointers read
+    auto inode_data_size = usable_inode_space - sizeof(CharString::length_prefix_t);
+    auto wanted = table.offset(field);
+    auto remaining = table.length(field);
+    auto current = header;
+    auto next = header_inode.next;
+    auto current_start = 0u;
+
+    stored = CharString();
+    while (remaining > 0u)
+    {
+        if (wanted >= current_start + inode_data_size)
+        {
+            if (next == 0u)
+                return false;
+            current = next;
+            next = read_inode_header(current).next;
+            current_start += inode_data_size;
+            continue;
+        }
+
+        auto within = wanted - current_start;
+        auto available = inode_data_size - within;
+        auto to_read = (remaining < available) ? remaining : available;
+        if (current != header)
+            stored += read_image(inode_data_address(current) + within, static_cast<uint16_t>(to_read));
+        else if (within + to_read <= header_inode.data.length())
+            stored += header_inode.data.read(within, to_read);
+        else
+            return false;
+
+        wanted += to_read;
+        remaining -= to_read;
+    }
+    return true;
+}
+
+CharString FileSystem::field_value(const FieldTable& table, FileField field, const CharString& stored)
+{
+    if (!table.shared(field))
+        return decode_field(table, field, stored);
+
+    if (stored.length() < sizeof(inode_t))
+        return CharString();
+
+    auto reference_bytes = CharString(stored);
+    auto reader = istream(&reference_bytes);
+    auto reference = inode_t(0u);
+    reader >> reference;
+    if (reference == 0u || reference >= _inode_count || !is_shared_string(read_inode_header(reference).flags))
+        return CharString();
+    return std::move(read_shared_string(reference).data.value);
+}
+
+inode_t FileSystem::find_username_reference(inode_t header)
+{
+    auto table = FieldTable();
+    auto stored = CharString();
+    if (read_stored_field(header, read_file_inode(header), FileField::Username, table, stored))
+    {
+        if (!table.shared(FileField::Username) || stored.length() < sizeof(inode_t))
+            return 0u;
+        auto reader = istream(&stored);
+        auto reference = inode_t(0u);
+        reader >> reference;
+        return reference;
+    }
+
+    // Records written before the field table always hold the username inline
+    return 0u;
+}
+
+File FileSystem::read_inode_to_file(inode_t inode)
+{
+    auto file_data = read_file_to_string(inode);
     auto file = File();
+
+    auto table = FieldTable();
+    if (read_field_table(file_data, table))
+    {
+        if (table.record_length() > file_data.length())
+            return file;
+
+        auto field_at = [&] (FileField field) {
+            return field_value(table, field, file_data.read(table.offset(field), table.length(field)));
+        };
+        file.name = field_at(FileField::Name);
+        file.username = field_at(FileField::Username);
+        file.password = field_at(FileField::Password);
+        return file;
+    }
+
+    auto file_stream = istream(&file_data);
     file_stream >> file;
     return file;
 }
 
-CharString FileSystem::read_file_to_string(unsigned int address)
+CharString FileSystem::read_file_to_string(inode_t inode)
 {
     CharString out;
-    auto data = read_file_inode(address);
+    auto data = read_file_inode(inode);
     while (data.next != 0)
     {
         out += data.data;
@@ -202,58 +700,176 @@ CharString FileSystem::read_file_to_string(unsigned int address)
     return out;
 }
 
-INode<CharString> FileSystem::read_file_inode(unsigned int address)
+INode<CharString> FileSystem::read_file_inode(inode_t inode)
 {
-    _istream.seekg(address);
-    auto data = INode<CharString>();
-    _istream >> data;
+    // The header and length in one transaction and the data in another, rather than one
+    // per field; most inodes are short enough that reading all INODE_SIZE bytes costs more
+    auto prefix = read_image(inode_to_address(inode), InodeHeaderLayout::size + sizeof(CharString::length_prefix_t));
+    auto reader = istream(&prefix);
+    auto header = INode<void>();
+    auto length = CharString::length_prefix_t(0u);
+    reader >> header >> length;
+    if (length > usable_inode_space - sizeof(CharString::length_prefix_t))
+        length = 0u;
+
+    auto data = INode<CharString>(header.next, false, read_image(inode_data_address(inode), static_cast<uint16_t>(length)));
+    data.flags = header.flags;
     return data;
 }
 
 
-INode<void> FileSystem::read_inode_header(unsigned int address)
+INode<void> FileSystem::read_inode_header(inode_t inode)
 {
-    _istream.seekg(address);
+    _istream.seekg(inode_to_address(inode));
     auto data = INode<void>();
     _istream >> data;
     return data;
 }
 
-either<unsigned int, FileSystemError> FileSystem::remove(const FileId& fileId)
+either<FileId, FileSystemError> FileSystem::remove(const FileId& fileId)
 {
-    auto header = read_inode_header(inode_to_address(fileId.value));
+    device_failed();
+    auto header = read_inode_header(fileId.value);
     if (!header.flags.is_file_header)
-        return FileSystemError::FileNotFound;
+        return device_failed() ? FileSystemError::DeviceError : FileSystemError::FileNotFound;
 
-    auto address = inode_to_address(fileId.value);
-    auto next_address = header.next;
-    free_inode(address);
+    _cache.invalidate(fileId);
+    restart_compaction();
+    mark_dirty();
 
-    while (next_address != 0)
+    header.flags.is_file_header = 0u;
+    header.flags.reclaiming = 1u;
+    set_inode_header(fileId.value, header);
+    _reclaim_pending = true;
+    _reclaim_rescan = true;
+
+    _master_block.file_headers--;
+    if (device_failed())
+        return FileSystemError::DeviceError;
+    return fileId;
+}
+
+bool FileSystem::reclaim_step()
+{
+    if (!_reclaim_pending)
+        return false;
+
+    auto removed = find_removed_header();
+    if (removed == 0u)
     {
-        header = read_inode_header(next_address);
-        free_inode(next_address);
-        next_address = header.next;
+        _reclaim_pending = false;
+        return false;
     }
 
-    write_master_block();
+    reclaim_file(removed);
+    return true;
+}
+
+bool FileSystem::reclaim_idle_step()
+{
+    if (!_reclaim_pending)
+        return false;
+
+    for (auto scanned = 0u; scanned < idle_scan_inodes; scanned++)
+    {
+        if (_reclaim_cursor >= _inode_count)
+        {
+            // A whole pass without finding anything, and no remove since it began
+            _reclaim_cursor = 1u;
+            if (!_reclaim_rescan)
+            {
+                _reclaim_pending = false;
+                return false;
+            }
+            _reclaim_rescan = false;
+        }
+
+        auto index = _reclaim_cursor++;
+        auto header = read_inode_header(index);
+        if (header.flags.in_use && header.flags.reclaiming)
+        {
+            reclaim_file(index);
+            _reclaim_rescan = true;
+            return true;
+        }
+    }
+    return true;
+}
+
+void FileSystem::reclaim_file(inode_t removed)
+{
+    // The journal entry carries the counts from after the reclaim, so a restart
+    // part way through only has to finish freeing the chain
+    auto username_reference = find_username_reference(removed);
+
+    // No separate mark_dirty() write; the journal entry carries the dirty state
+    _master_clean = false;
+    _master_block.free_inodes += chain_length(removed);
+    auto journal = FSMasterINode(removed, false, _master_block);
+    journal.flags.reclaiming = 1u;
+    write_master_inode(journal);
+
+    // The entry stays open; closing it would cost another write to the master inode
+    reclaim_chain(removed);
 
-    return address;
+    // Only once the record is gone; a restart before this leaks the reference instead
+    if (username_reference != 0u)
+        release_shared_string(username_reference);
+
+    restart_compaction();
+}
+
+void FileSystem::reclaim_chain(inode_t removed)
+{
+    // Bounded like chain_length(), so a corrupted cycle cannot hang the mount
+    auto next = read_inode_header(removed).next;
+    for (auto steps = 1u; next != 0u && steps < _inode_count; steps++)
+    {
+        auto member = read_inode_header(next);
+        if (member.flags.in_use)
+        {
+            auto freed = INode<void>();
+            freed.next = member.next;
+            set_inode_header(next, freed);
+        }
+        next = member.next;
+    }
+
+    set_inode_header(removed, INode<void>());
+}
+
+inode_t FileSystem::chain_length(inode_t header)
+{
+    auto length = inode_t(1u);
+    for (auto next = read_inode_header(header).next; next != 0u && length < _inode_count; length++)
+        next = read_inode_header(next).next;
+    return length;
+}
+
+inode_t FileSystem::find_removed_header()
+{
+    for (auto index = inode_t(1u); index < _inode_count; index++)
+    {
+        auto header = read_inode_header(index);
+        if (header.flags.in_use && header.flags.reclaiming)
+            return index;
+    }
+    return 0u;
 }
 
 vector<FileId> FileSystem::list_files()
 {
     auto file_count = static_cast<unsigned int>(count_files());
     auto filenames = vector<FileId>(file_count);
-    auto file_address = 0u;
+    auto file_inode = inode_t(0u);
     for (auto i = 0u; i < file_count; i++)
     {
-        get_next_file_header(file_address)
+        get_next_file_header(file_inode)
             .match(
                 [&](const auto& fileId) -> void
                 {
                     filenames.push_back(fileId);
-                    file_address = inode_to_address(fileId.value) + INODE_SIZE;
+                    file_inode = fileId.value + 1u;
                 },
                 [] (const auto&) {});
     }
@@ -261,30 +877,33 @@ vector<FileId> FileSystem::list_files()
     return filenames;
 }
 
-unsigned int FileSystem::request_free_inode()
+vector<inode_t> FileSystem::request_free_inodes(unsigned int count)
 {
-    auto inode_count = _eeprom->size / INODE_SIZE;
-    for (auto index = 1u; index < inode_count; index++)
+    auto inodes = vector<inode_t>(count);
+    auto index = _allocation_cursor;
+    for (auto scanned = 1u; scanned < _inode_count && inodes.size() < count; scanned++)
     {
-        auto address = inode_to_address(index);
-        auto inode = read_inode_header(address);
-        if (!inode.flags.in_use) {
-            inode.flags.in_use = 1u;
-            _ostream.seekg(address);
-            _ostream << inode;
-            _master_block.free_inodes--;
-            return address;
-        }
+        auto inode = read_inode_header(index);
+        _stats.allocation_scans++;
+        if (!inode.flags.in_use)
+            inodes.push_back(index);
+
+        index = (index + 1u < _inode_count) ? inode_t(index + 1u) : inode_t(1u);
     }
 
-    return -1;
+    if (inodes.size() < count)
+        return vector<inode_t>();
+
+    _allocation_cursor = index;
+    _master_block.free_inodes -= count;
+    return inodes;
 }
 
-void FileSystem::free_inode(unsigned int address)
+void FileSystem::free_inode(inode_t inode)
 {
-    auto header = read_inode_header(address);
+    auto header = read_inode_header(inode);
 
-    _ostream.seekg(address);
+    _ostream.seekg(inode_to_address(inode));
     _ostream << INode<void>();
 
     _master_block.free_inodes++;
@@ -292,19 +911,337 @@ void FileSystem::free_inode(unsigned int address)
         _master_block.file_headers--;
 }
 
-either<FileId, FileSystemError> FileSystem::get_next_file_header(unsigned int starting_address)
+either<FileId, FileSystemError> FileSystem::get_next_file_header(inode_t starting_inode)
 {
     if (_master_block.file_headers == 0u)
         return FileSystemError::FileNotFound;
 
-    auto inode_count = _eeprom->size / INODE_SIZE;
-    for (auto index = address_to_inode(starting_address); index < inode_count; index++)
+    auto inode_count = _inode_count;
+    for (auto index = starting_inode; index < inode_count; index++)
     {
-        auto address = inode_to_address(index);
-        auto header = read_inode_header(address);
+        auto header = read_inode_header(index);
+        _stats.header_scans++;
         if (header.flags.is_file_header)
             return FileId(index);
     }
 
     return FileSystemError::FileNotFound;
 }
+
+either<CompactProgress, FileSystemError> FileSystem::compact_step()
+{
+    // Free space left by removed files first, rather than moving their chains around
+    if (reclaim_step())
+        return CompactProgress::Running;
+
+    auto target = _compact_target;
+    if (target >= _inode_count)
+        return recount_step();
+
+    auto header = read_inode_header(target);
+    if (!header.flags.in_use)
+    {
+        // Pull the next file down into the hole; its chain follows in later steps
+        auto moved = false;
+        get_next_file_header(target + 1u)
+            .match(
+                [&] (const auto& file_id) {
+                    relocate_inode(file_id.value, target, 0u);
+                    moved = true;
+                },
+                [] (const auto&) {});
+
+        if (!moved)
+            _compact_target = _inode_count;
+        return CompactProgress::Running;
+    }
+
+    // Records refer to string table entries by inode, so those stay put and chains flow around them
+    if (is_shared_string(header.flags))
+    {
+        _compact_target = inode_t(target + 1u);
+        return CompactProgress::Running;
+    }
+
+    if (!header.flags.is_file_header)
+        return evacuate_inode(target);
+
+    auto previous = (_compact_previous != 0u) ? _compact_previous : target;
+    if (previous != target)
+        header = read_inode_header(previous);
+    auto slot = inode_t(previous + 1u);
+    while (header.next != 0u && slot < _inode_count)
+    {
+        if (header.next != slot)
+        {
+            auto occupant = read_inode_header(slot);
+            if (is_shared_string(occupant.flags))
+            {
+                slot++;
+                continue;
+            }
+
+            _compact_previous = previous;
+            if (occupant.flags.in_use)
+                return evacuate_inode(slot);
+
+            relocate_inode(header.next, slot, previous);
+            return CompactProgress::Running;
+        }
+
+        previous = slot;
+        header = read_inode_header(slot);
+        slot++;
+    }
+
+    _compact_target = slot;
+    _compact_previous = 0u;
+    return CompactProgress::Running;
+}
+
+CompactProgress FileSystem::recount_step()
+{
+    inode_t entries[recount_batch];
+    uint16_t references[recount_batch] = {};
+    auto count = 0u;
+    for (; _recount_target < _inode_count && count < recount_batch; _recount_target++)
+    {
+        if (is_shared_string(read_inode_header(_recount_target).flags))
+            entries[count++] = _recount_target;
+    }
+    if (count == 0u)
+        return CompactProgress::Complete;
+
+    // Headers still marked reclaiming hold their reference until the chain is freed
+    for (auto index = inode_t(1u); index < _inode_count; index++)
+    {
+        auto header = read_inode_header(index);
+        if (!header.flags.in_use || !(header.flags.is_file_header || header.flags.reclaiming))
+            continue;
+
+        auto reference = find_username_reference(index);
+        for (auto entry = 0u; entry < count && reference != 0u; entry++)
+        {
+            if (entries[entry] == reference)
+                references[entry]++;
+        }
+    }
+
+    for (auto entry = 0u; entry < count; entry++)
+    {
+        if (references[entry] != 0u && references[entry] == read_shared_string(entries[entry]).data.references)
+            continue;
+
+        mark_dirty();
+        if (references[entry] == 0u)
+        {
+            set_inode_header(entries[entry], INode<void>());
+            _master_block.free_inodes++;
+            _usernames.remove(entries[entry]);
+        }
+        else
+        {
+            _ostream.seekg(references_address(entries[entry]));
+            _ostream << references[entry];
+        }
+    }
+    return CompactProgress::Running;
+}
+
+either<CompactProgress, FileSystemError> FileSystem::evacuate_inode(inode_t inode)
+{
+    auto destination = find_last_free_inode(inode);
+    if (destination == 0u)
+        return FileSystemError::NotEnoughDiskSpace;
+
+    // Chains below the inode are already in place and end there, so its referrer is above it
+    auto header = read_inode_header(inode);
+    auto referrer = header.flags.is_file_header ? inode_t(0u) : find_referrer(inode, inode_t(inode + 1u));
+    relocate_inode(inode, destination, referrer);
+    return CompactProgress::Running;
+}
+
+void FileSystem::relocate_inode(inode_t source, inode_t destination, inode_t referrer)
+{
+    write_relocation_journal(source);
+
+    // Copy the whole inode in one write, flagged so recovery can find it
+    auto image = read_image(inode_to_address(source), INODE_SIZE);
+    auto reader = istream(&image);
+    auto header = INode<void>();
+    reader >> header;
+    header.flags.relocating = 1u;
+    auto writer = ostream(&image);
+    writer << header;
+    write_image(inode_to_address(destination), image);
+
+    if (referrer != 0u)
+    {
+        auto referrer_header = read_inode_header(referrer);
+        referrer_header.next = destination;
+        set_inode_header(referrer, referrer_header);
+    }
+
+    set_inode_header(source, INode<void>());
+    if (_compact_free_hint != 0u && source > _compact_free_hint)
+        _compact_free_hint = source;
+    _usernames.moved(source, destination);
+
+    header.flags.relocating = 0u;
+    set_inode_header(destination, header);
+
+    write_relocation_journal(0u);
+
+    if (header.flags.is_file_header)
+        _cache.clear();
+}
+
+void FileSystem::finish_relocation(inode_t source)
+{
+    auto destination = find_relocating_inode();
+    if (destination != 0u)
+    {
+        auto header = read_inode_header(source);
+        if (header.flags.in_use)
+        {
+            // The source is intact, so redo the whole move; the copy may be torn
+            auto referrer = header.flags.is_file_header ? inode_t(0u) : find_referrer(source);
+            relocate_inode(source, destination, referrer);
+            return;
+        }
+
+        auto destination_header = read_inode_header(destination);
+        destination_header.flags.relocating = 0u;
+        set_inode_header(destination, destination_header);
+    }
+
+    write_relocation_journal(0u);
+}
+
+void FileSystem::write_relocation_journal(inode_t source)
+{
+    // Only the header, so the counts and state behind it stay as they are
+    auto header = INode<void>();
+    header.next = source;
+    header.flags = Flags(1u, 0u);
+    header.flags.relocating = (source != 0u) ? 1u : 0u;
+    set_inode_header(0u, header);
+}
+
+void FileSystem::set_inode_header(inode_t inode, const INode<void>& header)
+{
+    // One device write, so a power loss cannot separate next from the flags
+    auto image = CharString(static_cast<unsigned int>(::size(header)));
+    auto writer = ostream(&image);
+    writer << header;
+    write_image(inode_to_address(inode), image);
+}
+
+inode_t FileSystem::find_referrer(inode_t inode, inode_t from)
+{
+    for (auto scanned = inode_t(1u); scanned < _inode_count; scanned++)
+    {
+        auto index = inode_t((from - 1u + scanned - 1u) % (_inode_count - 1u) + 1u);
+        auto header = read_inode_header(index);
+        if (header.flags.in_use && header.next == inode)
+            return index;
+    }
+    return 0u;
+}
+
+inode_t FileSystem::find_relocating_inode()
+{
+    for (auto index = inode_t(1u); index < _inode_count; index++)
+    {
+        auto header = read_inode_header(index);
+        if (header.flags.in_use && header.flags.relocating)
+            return index;
+    }
+    return 0u;
+}
+
+inode_t FileSystem::find_last_free_inode(inode_t after)
+{
+    // Evacuated inodes fill the free tail from the top down, so the search resumes below the
+    // last one taken; relocate_inode() raises the hint when it frees an inode above it
+    auto top = inode_t(_inode_count - 1u);
+    auto start = (_compact_free_hint > after && _compact_free_hint <= top) ? _compact_free_hint : top;
+    for (auto index = start; index > after; index--)
+    {
+        if (!read_inode_header(index).flags.in_use)
+            return _compact_free_hint = index;
+    }
+    return 0u;
+}
+
+void FileSystem::restart_compaction()
+{
+    _compact_target = 1u;
+    _compact_previous = 0u;
+    _compact_free_hint = 0u;
+}
+
+bool FileSystem::compacted() const
+{
+    return _compact_target >= _inode_count && _recount_target >= _inode_count;
+}
+
+uint32_t FileSystem::image_size() const
+{
+    return _eeprom->size;
+}
+
+inode_t FileSystem::inode_count() const
+{
+    return _inode_count;
+}
+
+bool FileSystem::inode_in_use(inode_t inode)
+{
+    return read_inode_header(inode).flags.in_use;
+}
+
+CharString FileSystem::read_image(address_t address, uint16_t size)
+{
+    return _eeprom->read(address, size);
+}
+
+void FileSystem::write_image(address_t address, const CharString& data)
+{
+    _eeprom->write(address, data.data(), data.length());
+}
+
+void FileSystem::clear_master_block()
+{
+    // Marked free, so mounting it neither recounts the inodes behind it nor trusts them
+    auto cleared = FSMasterINode(0u, false, FSMasterBlock());
+    cleared.flags.in_use = 0u;
+    write_master_inode(cleared);
+}
+
+void FileSystem::remount()
+{
+    _cache.clear();
+    sync_usage_record();
+}
+
+uint16_t FileSystem::page_writes(address_t address) const
+{
+    return _eeprom->page_writes(address);
+}
+
+const FileSystemStats& FileSystem::stats() const
+{
+    return _stats;
+}
+
+const DeviceStats& FileSystem::device_stats() const
+{
+    return _eeprom->stats();
+}
+
+void FileSystem::reset_stats()
+{
+    _stats = FileSystemStats();
+    _eeprom->reset_stats();
+}
@@ -8,15 +8,28 @@
 #include "char_string.h"
 #include "eeprom.h"
 #include "file.h"
+#include "file_cache.h"
+#include "file_record.h"
 #include "fs_master_block.h"
 #include "identifiers.h"
+#include "shared_string.h"
+#include "stats.h"
 #include "stream.h"
+#include "username_index.h"
 #include "vector.h"
 
 enum class FileSystemError
 {
     NotEnoughDiskSpace,
-    FileNotFound
+    FileNotFound,
+    // The device gave up on a bus transaction, so what was read or written cannot be trusted
+    DeviceError
+};
+
+enum class CompactProgress
+{
+    Running,
+    Complete
 };
 
 class FileSystem
@@ -25,27 +38,132 @@ class FileSystem
         std::unique_ptr<EEPROM> _eeprom;
         istream _istream;
         ostream _ostream;
-        size_t _inode_count;
+        inode_t _inode_count;
+
+        // Every inode must be reachable through the 16 bit INode::next
+        static constexpr uint32_t max_inodes = 0xFFFFul;
+        // Format version 0 kept byte addresses in INode::next and so stopped at 64 KB
+        static constexpr uint32_t version_0_max_bytes = 0x10000ul;
 
         FSMasterBlock _master_block;
+        FileSystemStats _stats;
+        FileCache _cache;
+        // Inodes below this are known to hold whole files, each chain in order and contiguous
+        inode_t _compact_target;
+        // The last member of the chain at _compact_target already in place, or 0 before its
+        // walk starts, so each step resumes the walk rather than following the chain again
+        inode_t _compact_previous;
+        // Where the search for a free inode to evacuate into resumes, or 0 to start at the top
+        inode_t _compact_free_hint;
+        // Shared string entries below this have had their references recounted since mount
+        inode_t _recount_target;
+        // Cleared once a scan finds no removed file still holding its chain
+        bool _reclaim_pending;
+        // Where reclaim_idle_step() resumes its scan, and whether the current pass has seen a
+        // removed file, or a remove behind the cursor, so another pass is needed
+        inode_t _reclaim_cursor;
+        bool _reclaim_rescan;
+        // Allocation resumes here rather than at inode 1, spreading writes across data inodes.
+        // It is kept in the master state with the counts, and like them is only written when
+        // the master block is, so mark_dirty() and flush_master_block() bracket each burst of
+        // commands. Inode 0 is not levelled; it takes those two writes, plus one per reclaim
+        // and two per compaction move.
+        inode_t _allocation_cursor;
+        // Whether the master state on the device says clean
+        bool _master_clean;
+        UsernameIndex _usernames;
 
+        // Whether the device gave up on a transaction since the last call. Commands call it
+        // once up front, since idle work has no one to report a failure to.
+        bool device_failed();
+        void write_master_block();
+        // Marks the master state dirty on the device, once, before a command changes any chain
+        // or the counts and cursor in RAM run ahead of those written
+        void mark_dirty();
+        // Only after an unclean shutdown do the counts need recounting and orphans freeing
         void sync_usage_record();
+        void recount_usage();
+        // Frees the chain members a write cut short left in use with nothing referring to
+        // them. Each pass over the headers marks the referrers of orphan_window inodes, in RAM.
+        void free_orphans();
+        static constexpr inode_t orphan_window = 256u;
+        void write_master_inode(const FSMasterINode& inode);
+        // Brings a device written by older firmware up to inode_format_version. Each inode
+        // records its own version, so an interrupted upgrade simply resumes on the next boot.
+        void upgrade_format();
+
+        // Returns count free inodes, searching round robin from the allocation cursor, or
+        // none if the device cannot supply them all. They are not marked in use until written,
+        // so callers write every other inode of a chain before the one that refers to it.
+        vector<inode_t> request_free_inodes(unsigned int count);
+        void free_inode(inode_t inode);
 
-        unsigned int request_free_inode();
-        void free_inode(unsigned int address);
+        // Moves an inode into a free one, journalled through the master inode so
+        // finish_relocation() can complete the move after a power loss
+        void relocate_inode(inode_t source, inode_t destination, inode_t referrer);
+        void finish_relocation(inode_t source);
+        void write_relocation_journal(inode_t source);
+        void set_inode_header(inode_t inode, const INode<void>& header);
+        // Scans from the given inode on, then wraps round to inode 1
+        inode_t find_referrer(inode_t inode, inode_t from = 1u);
+        inode_t find_relocating_inode();
+        inode_t find_last_free_inode(inode_t after);
+        // Every write or remove may leave a hole below _compact_target
+        void restart_compaction();
+        // Frees the chain behind a removed file's header, then the header. Freed members keep
+        // their next and the header is left alone until last, so this can be rerun after a
+        // restart and the record stays readable until the header goes.
+        void reclaim_chain(inode_t header);
+        // Inodes in the chain starting at header, stopping after _inode_count
+        inode_t chain_length(inode_t header);
+        void reclaim_file(inode_t removed);
+        inode_t find_removed_header();
 
-        either<FileId, FileSystemError> get_next_file_header(unsigned int starting_address);
+        // Usernames shared by more than one record live once in a table of single inode
+        // entries that compaction leaves in place. A reference is taken before a record is
+        // written and dropped only after its chain is freed, so a power loss can leak an
+        // entry but never strand a record.
+        inode_t acquire_shared_string(const CharString& value);
+        void release_shared_string(inode_t inode);
+        SharedStringINode read_shared_string(inode_t inode);
+        // Fills _usernames from one pass over the device
+        void index_usernames();
+        // The string table entry holding value, with shared set, or the header of a record
+        // holding it inline, as far as _usernames knows; 0 if it knows neither
+        inode_t find_username(const CharString& value, bool& shared);
+        // A record's username as stored inline; empty if it refers to the string table
+        CharString inline_username(inode_t header, const INode<CharString>& header_inode);
+
+        // Moves whatever occupies inode out of the way, to the last free inode
+        either<CompactProgress, FileSystemError> evacuate_inode(inode_t inode);
+        // Once chains are in place, recounts the references to up to recount_batch shared
+        // string entries in one pass over the records, freeing those with none. This is how
+        // entries leaked by a restart between freeing a chain and releasing its reference are
+        // recovered.
+        CompactProgress recount_step();
+        static constexpr uint8_t recount_batch = 8u;
+
+        either<FileId, FileSystemError> get_next_file_header(inode_t starting_inode);
         either<FileId, FileSystemError> get_fileid_by_filename(const CharString& filename);
 
-        File read_address_to_file(unsigned int address);
-        CharString read_file_to_string(unsigned int address);
-        INode<CharString> read_file_inode(unsigned int address);
-        INode<void> read_inode_header(unsigned int address);
+        File read_inode_to_file(inode_t inode);
+        // Gathers one field as stored, walking only the chain up to it. Returns false for
+        // records without a field table, which have to be read whole.
+        bool read_stored_field(
+                inode_t header,
+                const INode<CharString>& header_inode,
+                FileField field,
+                FieldTable& table,
+                CharString& stored);
+        CharString field_value(const FieldTable& table, FileField field, const CharString& stored);
+        inode_t find_username_reference(inode_t header);
+        CharString read_file_to_string(inode_t inode);
+        INode<CharString> read_file_inode(inode_t inode);
+        INode<void> read_inode_header(inode_t inode);
 
-        CharString write_file_to_string(const File& file) const;
         void write_inode(
-                unsigned int inode_address,
-                unsigned int next_address,
+                inode_t inode,
+                inode_t next,
                 unsigned int start_index,
                 unsigned int bytes_to_write,
                 const CharString& to_write);
@@ -55,13 +173,29 @@ class FileSystem
             : _eeprom(std::move(eeprom)),
             _istream(_eeprom.get()),
             _ostream(_eeprom.get()),
-            _inode_count(_eeprom->size / INODE_SIZE),
-            _master_block()
+            _inode_count(static_cast<inode_t>((_eeprom->size / INODE_SIZE < max_inodes) ? _eeprom->size / INODE_SIZE : max_inodes)),
+            _master_block(),
+            _stats(),
+            _cache(),
+            _compact_target(1u),
+            _compact_previous(0u),
+            _compact_free_hint(0u),
+            _recount_target(1u),
+            _reclaim_pending(true),
+            _reclaim_cursor(1u),
+            _reclaim_rescan(true),
+            _allocation_cursor(1u),
+            _master_clean(false),
+            _usernames()
         {
             sync_usage_record();
         }
 
-        void write_master_block();
+        // Writes the counts and cursor and marks the device clean, if anything has changed
+        // since they were last written. The firmware calls it once the host has gone quiet;
+        // host tools before they let go of an image.
+        void flush_master_block();
+        bool master_clean() const;
         size_t count_free_space();
         size_t count_files();
 
@@ -71,6 +205,40 @@ class FileSystem
         either<File, FileSystemError> read(const CharString& filename);
         either<File, FileSystemError> read(const FileId& fileId);
         either<CharString, FileSystemError> get_filename(const FileId& fileId);
-        either<unsigned int, FileSystemError> remove(const FileId& fileId);
+        // Reads a single field, touching only the inodes that hold it
+        either<CharString, FileSystemError> read_field(const FileId& fileId, FileField field);
+        // Only rewrites the file header; the chain is freed later by reclaim_step()
+        either<FileId, FileSystemError> remove(const FileId& fileId);
+        // Frees the chain of one removed file and reports whether there may be more
+        bool reclaim_step();
+        // As reclaim_step(), but scans at most idle_scan_inodes headers per call, resuming
+        // where it stopped, so it can run between commands without holding one up
+        bool reclaim_idle_step();
+        static constexpr uint8_t idle_scan_inodes = 16u;
         vector<FileId> list_files();
+
+        // Does at most one inode move towards every file chain being contiguous and all
+        // free inodes forming a single tail region, then recounts a batch of shared string
+        // entries per step. Moving a file header changes its FileId.
+        either<CompactProgress, FileSystemError> compact_step();
+        // Whether compaction has completed and nothing has been written or removed since
+        bool compacted() const;
+
+        // Raw device access for image backup and restore. Writing the image underneath the
+        // file system leaves it stale until remount() is called.
+        uint32_t image_size() const;
+        inode_t inode_count() const;
+        bool inode_in_use(inode_t inode);
+        CharString read_image(address_t address, uint16_t size);
+        void write_image(address_t address, const CharString& data);
+        // Writes an empty master block, which mounts as a device with no files and no free
+        // space, for an image that is only partly written
+        void clear_master_block();
+        void remount();
+        // Page writes since start up, when built with PAGE_WRITE_COUNTERS
+        uint16_t page_writes(address_t address) const;
+
+        const FileSystemStats& stats() const;
+        const DeviceStats& device_stats() const;
+        void reset_stats();
 };
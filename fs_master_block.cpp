@@ -1,20 +1,56 @@
 #include "fs_master_block.h"
+#include "packed_layout.h"
 #include "stream.h"
 #include "size.h"
 
+static_assert(FSMasterBlock::CountersLayout::size == 8u, "Master block counters take eight bytes on every target");
+static_assert(FSMasterBlock::CountersLayout::offset<1> == 4u, "file_headers follows free_inodes");
+static_assert(FSMasterState::Layout::size == 3u, "Master state takes three bytes on every target");
+
 ostream& operator<<(ostream& stream, const FSMasterBlock& block)
 {
-    stream << block.free_inodes << block.file_headers << block.encryption_iv << block.challenge;
+    auto counters = FSMasterBlock::CountersLayout::Buffer();
+    FSMasterBlock::CountersLayout::store<0>(counters, block.free_inodes);
+    FSMasterBlock::CountersLayout::store<1>(counters, block.file_headers);
+    stream.write(counters.data(), FSMasterBlock::CountersLayout::size);
+    stream << block.encryption_iv << block.challenge;
     return stream;
 }
 
 istream& operator>>(istream& stream, FSMasterBlock& block)
 {
-    stream >> block.free_inodes >> block.file_headers >> block.encryption_iv >> block.challenge;
+    auto counters = FSMasterBlock::CountersLayout::Buffer();
+    stream.read(counters.data(), FSMasterBlock::CountersLayout::size);
+    block.free_inodes = FSMasterBlock::CountersLayout::load<0>(counters);
+    block.file_headers = FSMasterBlock::CountersLayout::load<1>(counters);
+    stream >> block.encryption_iv >> block.challenge;
     return stream;
 }
 
 uint16_t FSMasterBlock::size() const
 {
-    return ::size(free_inodes) + ::size(file_headers) + ::size(encryption_iv) + ::size(challenge);
+    return CountersLayout::size + ::size(encryption_iv) + ::size(challenge);
+}
+
+ostream& operator<<(ostream& stream, const FSMasterState& state)
+{
+    auto fields = FSMasterState::Layout::Buffer();
+    FSMasterState::Layout::store<0>(fields, state.allocation_cursor);
+    FSMasterState::Layout::store<1>(fields, static_cast<uint8_t>(state.clean ? 1u : 0u));
+    stream.write(fields.data(), FSMasterState::Layout::size);
+    return stream;
+}
+
+istream& operator>>(istream& stream, FSMasterState& state)
+{
+    auto fields = FSMasterState::Layout::Buffer();
+    stream.read(fields.data(), FSMasterState::Layout::size);
+    state.allocation_cursor = FSMasterState::Layout::load<0>(fields);
+    state.clean = FSMasterState::Layout::load<1>(fields) == 1u;
+    return stream;
+}
+
+uint16_t FSMasterState::size() const
+{
+    return Layout::size;
 }
@@ -2,11 +2,15 @@
 
 #include "char_string.h"
 #include "inode.h"
+#include "packed_layout.h"
 #include "stream.h"
 #include <utility.h>
 
 struct FSMasterBlock
 {
+    // free_inodes, then file_headers; the two strings follow
+    using CountersLayout = packed::Layout<uint32_t, uint32_t>;
+
     uint32_t free_inodes;
     uint32_t file_headers;
     CharString encryption_iv;
@@ -35,3 +39,32 @@ ostream& operator<<(ostream& stream, const FSMasterBlock& block);
 istream& operator>>(istream& stream, FSMasterBlock& block);
 
 using FSMasterINode = INode<FSMasterBlock>;
+
+// Follows the master block's strings, where version 0 images ended, so it never shifts them.
+// GetMasterBlock leaves it out.
+struct FSMasterState
+{
+    // allocation_cursor, then clean
+    using Layout = packed::Layout<inode_t, uint8_t>;
+
+    // Where allocation resumes, kept apart from the master inode's next so that an open
+    // journal entry does not lose it
+    inode_t allocation_cursor;
+    // Set only while the counts and cursor are exact and no command has changed the device
+    // since they were written, so mounting can skip its recount
+    bool clean;
+
+    FSMasterState(inode_t cursor, bool is_clean)
+        : allocation_cursor(cursor),
+        clean(is_clean)
+    {}
+
+    FSMasterState()
+        : FSMasterState(0u, false)
+    {}
+
+    uint16_t size() const;
+};
+
+ostream& operator<<(ostream& stream, const FSMasterState& state);
+istream& operator>>(istream& stream, FSMasterState& state);
@@ -0,0 +1,411 @@
+// bluefish-bench: runs the workloads of a credential manager through the serial protocol
+// against a scratch image and reports what each cost on the modelled hardware, so firmware
+// changes can be compared by a script:
+//
+//   bluefish-bench [seed]
+//
+// The workloads are an import of import_count credentials, lookups by name, churn that
+// replaces the password of listed files, repeated listing and formatting, in that order and
+// on the same device. Requests run back to back as a host syncing a vault sends them, and
+// the idle work a workload leaves behind is counted to it. Times come from the BusCost
+// timing model; peak_heap is the most the host heap grew by during the workload, as the
+// firmware's allocations are the only ones made while it runs.
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <Arduino.h>
+
+#include "api.h"
+#include "binary_api.h"
+#include "bus_cost.h"
+#include "mapped_image.h"
+#include "transaction_trace.h"
+
+static constexpr unsigned int import_count = 500u;
+static constexpr unsigned int lookup_count = 500u;
+static constexpr unsigned int churn_count = 100u;
+// Churn lists the files again after this many replacements, as a host refreshes its view
+static constexpr unsigned int churn_round = 25u;
+static constexpr unsigned int list_count = 20u;
+static constexpr unsigned int format_count = 2u;
+
+// Polls after a workload that may still be idle work; a reclaim takes a few hundred
+static constexpr unsigned int idle_poll_limit = 100000u;
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+extern "C" void __libc_free(void* pointer);
+
+static size_t heap_in_use = 0u;
+static size_t heap_peak = 0u;
+
+static void heap_allocated(void* pointer)
+{
+    if (pointer == nullptr)
+        return;
+    heap_in_use += malloc_usable_size(pointer);
+    if (heap_in_use > heap_peak)
+        heap_peak = heap_in_use;
+}
+
+static void heap_freed(void* pointer)
+{
+    if (pointer == nullptr)
+        return;
+    // Blocks from before the counting started, or from allocators not counted, are not known
+    auto size = malloc_usable_size(pointer);
+    heap_in_use = (size < heap_in_use) ? heap_in_use - size : 0u;
+}
+
+extern "C" void* malloc(size_t size)
+{
+    auto* pointer = __libc_malloc(size);
+    heap_allocated(pointer);
+    return pointer;
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    auto* pointer = __libc_calloc(count, size);
+    heap_allocated(pointer);
+    return pointer;
+}
+
+extern "C" void* realloc(void* pointer, size_t size)
+{
+    heap_freed(pointer);
+    auto* moved = __libc_realloc(pointer, size);
+    heap_allocated((moved != nullptr || size == 0u) ? moved : pointer);
+    return moved;
+}
+
+extern "C" void free(void* pointer)
+{
+    heap_freed(pointer);
+    __libc_free(pointer);
+}
+
+// The firmware's idle hook; the image never keeps the driver waiting
+void yield() {}
+
+struct WorkloadResult
+{
+    unsigned int operations = 0u;
+    unsigned int failures = 0u;
+    BusCost cost;
+    size_t peak_heap = 0u;
+};
+
+// The bench keeps to fixed buffers, so the heap it measures is the firmware's
+static char request[1024];
+static size_t request_length = 0u;
+static unsigned char reply[4096];
+static size_t reply_length = 0u;
+static uint16_t ids[1024];
+static size_t id_count = 0u;
+
+static int to_device = -1;
+static int from_device = -1;
+static BinaryAPI* api = nullptr;
+static WorkloadResult* current = nullptr;
+static uint32_t random_state = 1u;
+
+static const char* const usernames[] = {
+    "alice@example.com",
+    "alice.work@example.org",
+    "alice",
+    "a.liddell@mail.example.net"
+};
+
+static uint32_t next_random()
+{
+    // xorshift32, as the on-device benchmark draws its passwords
+    random_state ^= random_state << 13u;
+    random_state ^= random_state >> 17u;
+    random_state ^= random_state << 5u;
+    return random_state;
+}
+
+static void begin_request(Command command)
+{
+    request[0] = static_cast<char>(command);
+    request_length = 1u;
+}
+
+static void add_bytes(const void* data, size_t length)
+{
+    memcpy(request + request_length, data, length);
+    request_length += length;
+}
+
+static void add_id(uint16_t id)
+{
+    add_bytes(&id, sizeof(id));
+}
+
+static void add_string(const char* text, size_t length)
+{
+    auto prefix = static_cast<uint16_t>(length);
+    add_bytes(&prefix, sizeof(prefix));
+    add_bytes(text, length);
+}
+
+static void add_string(const char* text)
+{
+    add_string(text, strlen(text));
+}
+
+static void add_password()
+{
+    char password[16];
+    for (auto& c : password)
+        c = static_cast<char>('!' + next_random() % 94u);
+    add_string(password, sizeof(password));
+}
+
+static void add_credential(const char* name, size_t name_length, unsigned int index)
+{
+    add_string(name, name_length);
+    add_string(usernames[index % (sizeof(usernames) / sizeof(usernames[0]))]);
+    add_password();
+}
+
+static size_t site_name(unsigned int index, char* name, size_t size)
+{
+    return static_cast<size_t>(snprintf(name, size, "site%u.example.com", index));
+}
+
+static void drain_trace()
+{
+    while (transaction_trace.size() > 0u)
+        current->cost.add(transaction_trace.pop());
+}
+
+// Runs one poll, returning true if it cost anything on either bus
+static bool poll_once()
+{
+    auto before = current->cost;
+    api->poll();
+    drain_trace();
+    return current->cost.transactions() != before.transactions()
+        || current->cost.serial_written != before.serial_written;
+}
+
+// Sends the request, polls until the device has handled it and collects the reply less the
+// Ready that came before it. Returns the status byte, which ListFiles does not send.
+static uint8_t exchange()
+{
+    if (write(to_device, request, request_length) != static_cast<ssize_t>(request_length))
+    {
+        perror("bluefish-bench");
+        exit(1);
+    }
+
+    auto handled = current->cost.commands + 1u;
+    while (current->cost.commands < handled)
+        poll_once();
+
+    reply_length = 0u;
+    for (ssize_t received; (received = read(from_device, reply + reply_length,
+        sizeof(reply) - reply_length)) > 0;)
+        reply_length += static_cast<size_t>(received);
+    if (reply_length < 2u)
+        return static_cast<uint8_t>(CommandStatus::Fail);
+    return reply[1];
+}
+
+static bool succeeded(uint8_t status)
+{
+    if (status == static_cast<uint8_t>(CommandStatus::OK))
+        return true;
+    current->failures++;
+    return false;
+}
+
+// ListFiles sends a u8 count, which wraps past 255 files, so the ids are taken from the
+// length of the reply instead
+static void list_ids()
+{
+    begin_request(Command::ListFiles);
+    exchange();
+    id_count = (reply_length > 2u) ? (reply_length - 2u) / sizeof(uint16_t) : 0u;
+    memcpy(ids, reply + 2u, id_count * sizeof(uint16_t));
+}
+
+static void import()
+{
+    char name[32];
+    for (auto i = 0u; i < import_count; i++, current->operations++)
+    {
+        begin_request(Command::WriteFile);
+        add_credential(name, site_name(i, name, sizeof(name)), i);
+        succeeded(exchange());
+    }
+}
+
+static void lookup()
+{
+    char name[32];
+    for (auto i = 0u; i < lookup_count; i++, current->operations++)
+    {
+        begin_request(Command::ReadFile);
+        add_string(name, site_name(next_random() % import_count, name, sizeof(name)));
+        succeeded(exchange());
+    }
+}
+
+static void churn()
+{
+    for (auto i = 0u; i < churn_count; i++)
+    {
+        if (i % churn_round == 0u)
+            list_ids();
+        if (id_count == 0u)
+            return;
+
+        // Each file is replaced once a round, as a new id is only seen on the next listing
+        auto position = next_random() % id_count;
+        auto id = ids[position];
+        ids[position] = ids[--id_count];
+        current->operations++;
+
+        begin_request(Command::GetFileName);
+        add_id(id);
+        if (!succeeded(exchange()))
+            continue;
+        char name[256];
+        auto name_length = (reply_length >= 4u) ? static_cast<size_t>(reply[2] | (reply[3] << 8u)) : 0u;
+        if (name_length == 0u || name_length > sizeof(name) || reply_length < 4u + name_length)
+        {
+            current->failures++;
+            continue;
+        }
+        memcpy(name, reply + 4u, name_length);
+
+        begin_request(Command::RemoveFile);
+        add_id(id);
+        if (!succeeded(exchange()))
+            continue;
+
+        begin_request(Command::WriteFile);
+        add_credential(name, name_length, next_random());
+        succeeded(exchange());
+    }
+}
+
+static void list()
+{
+    for (auto i = 0u; i < list_count; i++, current->operations++)
+        list_ids();
+}
+
+static void format()
+{
+    for (auto i = 0u; i < format_count; i++, current->operations++)
+    {
+        begin_request(Command::Format);
+        add_string("0123456789abcdef");
+        add_string("bluefish-bench");
+        succeeded(exchange());
+    }
+}
+
+static WorkloadResult run(void (*workload)())
+{
+    auto result = WorkloadResult();
+    current = &result;
+    auto heap_before = heap_in_use;
+    heap_peak = heap_in_use;
+
+    workload();
+    // Leaves the device as quiet as the next workload would find it after a pause
+    for (auto polls = 0u; polls < idle_poll_limit && poll_once(); polls++) {}
+
+    result.peak_heap = heap_peak - heap_before;
+    current = nullptr;
+    return result;
+}
+
+static void print(const char* workload, const WorkloadResult& result)
+{
+    const auto& cost = result.cost;
+    printf("%s\t%u\t%u\t%.1f\t%.1f\t%.1f\t%.1f\t%u\t%u\t%u\t%u\t%u\t%u\t%zu\n", workload,
+        result.operations, result.failures, cost.modelled_us() / 1000.0, cost.uart_us() / 1000.0,
+        cost.bus_us() / 1000.0, cost.write_cycles_us() / 1000.0, cost.transactions(), cost.writes,
+        cost.bytes_read, cost.bytes_written, cost.serial_read + cost.serial_written,
+        cost.commands, result.peak_heap);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 2 || (argc == 2 && (random_state = strtoul(argv[1], nullptr, 0)) == 0u))
+    {
+        fprintf(stderr, "usage: bluefish-bench [seed]\n"
+            "Runs the benchmark workloads against a scratch image and prints a tab separated\n"
+            "line of modelled time and bus counts per workload. The seed must not be 0.\n");
+        return 2;
+    }
+
+    char directory[] = "/tmp/bluefish-bench.XXXXXX";
+    if (mkdtemp(directory) == nullptr)
+    {
+        perror("bluefish-bench");
+        return 1;
+    }
+    char image[sizeof(directory) + 8];
+    snprintf(image, sizeof(image), "%s/image", directory);
+    MappedImage::default_path = image;
+    MappedImage::default_access = MappedImage::Access::Create;
+
+    int requests[2], replies[2];
+    if (pipe(requests) != 0 || pipe(replies) != 0)
+    {
+        perror("bluefish-bench");
+        return 1;
+    }
+    fcntl(replies[0], F_SETFL, O_NONBLOCK);
+    to_device = requests[1];
+    from_device = replies[0];
+    Serial.attach(requests[0], replies[1]);
+
+    printf("workload\toperations\tfailures\tmodelled_ms\tuart_ms\tbus_ms\twrite_cycle_ms"
+        "\ttransactions\twrite_cycles\tbytes_read\tbytes_written\tserial_bytes\tcommands"
+        "\tpeak_heap\n");
+    fflush(stdout);
+
+    auto device = BinaryAPI();
+    api = &device;
+    // A fresh image mounts unformatted, so the device is formatted before anything is timed
+    run(format);
+
+    static const struct
+    {
+        const char* name;
+        void (*workload)();
+    } workloads[] = {
+        { "import", import }, { "lookup", lookup }, { "churn", churn }, { "list", list },
+        { "format", format }
+    };
+
+    auto failed = false;
+    for (const auto& workload : workloads)
+    {
+        auto result = run(workload.workload);
+        print(workload.name, result);
+        failed = failed || result.failures != 0u;
+    }
+
+    unlink(image);
+    rmdir(directory);
+    if (transaction_trace.dropped() != 0u)
+    {
+        fprintf(stderr, "%u trace events were dropped; the counts are short\n", transaction_trace.dropped());
+        failed = true;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,154 @@
+// bluefish-client: a small command line front end to BluefishClient
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bluefish_client.h"
+
+typedef BluefishClient::Command Command;
+typedef BluefishClient::Request Request;
+typedef BluefishClient::Reply Reply;
+
+static int usage()
+{
+    fprintf(stderr,
+        "usage: bluefish-client <port> <command> [arguments]\n"
+        "  list                             every file id and name, fetched in one pipelined batch\n"
+        "  read <name>                      one file's username and password\n"
+        "  write <name> <user> <password>\n"
+        "  remove <id>\n"
+        "  master                           the master block counts\n"
+        "  format <iv> <challenge>\n");
+    return 2;
+}
+
+static const char* describe(ClientError error)
+{
+    switch (error)
+    {
+        case ClientError::Timeout:
+            return "no reply";
+        case ClientError::Disconnected:
+            return "disconnected";
+        case ClientError::TooLarge:
+            return "request too large";
+        default:
+            return "unexpected reply";
+    }
+}
+
+static void print(std::string_view value)
+{
+    fwrite(value.data(), 1u, value.size(), stdout);
+}
+
+// Runs one request, handing its reply to on_reply; the exit status of the command
+template <typename OnReply>
+static int run(BluefishClient& client, const Request& request, OnReply&& on_reply)
+{
+    return client.call(request).match(
+        [&on_reply] (Reply& reply)
+        {
+            if (reply.ok())
+                return on_reply(reply);
+            fprintf(stderr, "device answered %u\n", static_cast<unsigned int>(reply.status()));
+            return 1;
+        },
+        [] (ClientError error)
+        {
+            fprintf(stderr, "%s\n", describe(error));
+            return 1;
+        });
+}
+
+static int list(BluefishClient& client)
+{
+    auto ids = std::vector<uint16_t>();
+    auto status = run(client, Request(Command::ListFiles), [&ids] (Reply& reply) {
+        auto reader = reply.reader();
+        ids = BluefishClient::parse_file_ids(reader);
+        return 0;
+    });
+    if (status != 0)
+        return status;
+
+    auto requests = std::vector<Request>();
+    for (auto id : ids)
+        requests.push_back(Request(Command::GetFileName).u16(id));
+
+    auto pipelined = client.set_pipelining(true).match(
+        [] (bool) { return true; },
+        [] (ClientError) { return false; });
+    status = client.send(requests).match(
+        [&ids] (std::vector<Reply>& replies)
+        {
+            for (auto index = 0u; index < replies.size(); index++)
+            {
+                printf("%5u  ", ids[index]);
+                if (replies[index].ok())
+                    print(replies[index].reader().string());
+                else
+                    printf("<unreadable>");
+                putchar('\n');
+            }
+            return 0;
+        },
+        [] (ClientError error)
+        {
+            fprintf(stderr, "%s\n", describe(error));
+            return 1;
+        });
+
+    if (pipelined)
+        client.set_pipelining(false);
+    return status;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+        return usage();
+
+    auto fd = BluefishClient::open_serial(argv[1]);
+    if (fd < 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    auto client = BluefishClient(fd);
+    auto command = std::string_view(argv[2]);
+    auto ok = [] (Reply&) { return 0; };
+
+    if (command == "list" && argc == 3)
+        return list(client);
+    if (command == "read" && argc == 4)
+        return run(client, Request(Command::ReadFile).string(argv[3]), [] (Reply& reply) {
+            auto reader = reply.reader();
+            auto file = BluefishClient::parse_file(reader);
+            printf("username  ");
+            print(file.username);
+            printf("\npassword  ");
+            print(file.password);
+            putchar('\n');
+            return 0;
+        });
+    if (command == "write" && argc == 6)
+        return run(client, Request(Command::WriteFile).string(argv[3]).string(argv[4]).string(argv[5]), ok);
+    if (command == "remove" && argc == 4)
+        return run(client, Request(Command::RemoveFile).u16(static_cast<uint16_t>(atoi(argv[3]))), ok);
+    if (command == "format" && argc == 5)
+        return run(client, Request(Command::Format).string(argv[3]).string(argv[4]), ok);
+    if (command == "master" && argc == 3)
+        return run(client, Request(Command::GetMasterBlock), [] (Reply& reply) {
+            auto reader = reply.reader();
+            auto block = BluefishClient::parse_master_block(reader);
+            printf("files        %u\nfree inodes  %u\n", block.file_headers, block.free_inodes);
+            return 0;
+        });
+    return usage();
+}
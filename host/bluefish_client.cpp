@@ -0,0 +1,473 @@
+#include "bluefish_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+// The u8 tag and u16 length in front of each pipelined request
+static constexpr size_t frame_header_size = 3u;
+static constexpr uint16_t end_of_inodes = 0xFFFFu;
+static constexpr size_t inode_size = 64u;
+static constexpr size_t trace_event_size = 12u;
+// operations, failures, elapsed µs, six device counters and the peak heap
+static constexpr size_t benchmark_result_size = 2u + 2u + 4u + 6u * 4u + 2u;
+// Six device, three serial and four filesystem counters
+static constexpr size_t stats_counters = 13u;
+
+// Keeps the error of a failed step, so a sequence of steps can stop at the first one
+template <typename T>
+static bool failed(either<T, ClientError>&& result, ClientError& error)
+{
+    return result.match(
+        [] (const T&) { return false; },
+        [&error] (ClientError reason) { error = reason; return true; });
+}
+
+BluefishClient::Request& BluefishClient::Request::u8(uint8_t value)
+{
+    _arguments.push_back(static_cast<char>(value));
+    return *this;
+}
+
+BluefishClient::Request& BluefishClient::Request::u16(uint16_t value)
+{
+    return u8(static_cast<uint8_t>(value)).u8(static_cast<uint8_t>(value >> 8u));
+}
+
+BluefishClient::Request& BluefishClient::Request::u32(uint32_t value)
+{
+    return u16(static_cast<uint16_t>(value)).u16(static_cast<uint16_t>(value >> 16u));
+}
+
+BluefishClient::Request& BluefishClient::Request::string(std::string_view value)
+{
+    return u16(static_cast<uint16_t>(value.size())).bytes(value);
+}
+
+BluefishClient::Request& BluefishClient::Request::bytes(std::string_view value)
+{
+    _arguments.append(value);
+    return *this;
+}
+
+BluefishClient::Command BluefishClient::Request::command() const
+{
+    return _command;
+}
+
+const std::string& BluefishClient::Request::arguments() const
+{
+    return _arguments;
+}
+
+uint8_t BluefishClient::Reader::u8()
+{
+    auto data = bytes(1u);
+    return data.empty() ? 0u : static_cast<uint8_t>(data[0]);
+}
+
+uint16_t BluefishClient::Reader::u16()
+{
+    auto low = u8();
+    return static_cast<uint16_t>(low | (u8() << 8u));
+}
+
+uint32_t BluefishClient::Reader::u32()
+{
+    auto low = u16();
+    return low | (static_cast<uint32_t>(u16()) << 16u);
+}
+
+std::string_view BluefishClient::Reader::string()
+{
+    return bytes(u16());
+}
+
+std::string_view BluefishClient::Reader::bytes(size_t size)
+{
+    if (_exhausted || size > _data.size() - _position)
+    {
+        _exhausted = true;
+        return {};
+    }
+
+    auto data = _data.substr(_position, size);
+    _position += size;
+    return data;
+}
+
+size_t BluefishClient::Reader::position() const
+{
+    return _position;
+}
+
+bool BluefishClient::Reader::exhausted() const
+{
+    return _exhausted;
+}
+
+BluefishClient::Command BluefishClient::Reply::command() const
+{
+    return _command;
+}
+
+std::string_view BluefishClient::Reply::body() const
+{
+    return _body;
+}
+
+BluefishClient::Status BluefishClient::Reply::status() const
+{
+    if (_command == Command::ListFiles || _command == Command::GetMasterBlock)
+        return Status::OK;
+    return _body.empty() ? Status::Fail : static_cast<Status>(_body[0]);
+}
+
+bool BluefishClient::Reply::ok() const
+{
+    return status() == Status::OK;
+}
+
+BluefishClient::Reader BluefishClient::Reply::reader() const
+{
+    auto reader = Reader(_body);
+    if (_command != Command::ListFiles && _command != Command::GetMasterBlock)
+        reader.u8();
+    return reader;
+}
+
+int BluefishClient::open_serial(const char* path)
+{
+    auto fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+        return -1;
+
+    struct termios settings;
+    if (tcgetattr(fd, &settings) == 0)
+    {
+        cfmakeraw(&settings);
+        cfsetispeed(&settings, B115200);
+        cfsetospeed(&settings, B115200);
+        tcsetattr(fd, TCSANOW, &settings);
+    }
+    return fd;
+}
+
+void BluefishClient::set_timeout(int timeout_ms)
+{
+    _timeout_ms = timeout_ms;
+}
+
+bool BluefishClient::pipelined() const
+{
+    return _pipelined;
+}
+
+either<bool, ClientError> BluefishClient::send_bytes(const std::string& data)
+{
+    for (auto written = size_t(0u); written < data.size();)
+    {
+        auto sent = write(_fd, data.data() + written, data.size() - written);
+        if (sent > 0)
+            written += static_cast<size_t>(sent);
+        else if (sent < 0 && errno != EINTR && errno != EAGAIN)
+            return ClientError::Disconnected;
+    }
+    return true;
+}
+
+either<bool, ClientError> BluefishClient::receive_more()
+{
+    auto waiting = pollfd{ _fd, POLLIN, 0 };
+    auto ready = poll(&waiting, 1, _timeout_ms);
+    if (ready == 0)
+        return ClientError::Timeout;
+    if (ready < 0 && errno == EINTR)
+        return true;
+
+    char buffer[4096];
+    auto received = (ready > 0) ? read(_fd, buffer, sizeof(buffer)) : -1;
+    if (received <= 0)
+        return ClientError::Disconnected;
+
+    _received.append(buffer, static_cast<size_t>(received));
+    return true;
+}
+
+either<bool, ClientError> BluefishClient::wait_for_ready(size_t offset)
+{
+    // Anything before Ready is left over from an exchange this client did not start
+    while (true)
+    {
+        auto ready = _received.find(static_cast<char>(Status::Ready), offset);
+        if (ready != std::string::npos)
+        {
+            _received.erase(offset, ready + 1u - offset);
+            return true;
+        }
+
+        _received.erase(offset);
+        auto error = ClientError::Protocol;
+        if (failed(receive_more(), error))
+            return error;
+    }
+}
+
+size_t BluefishClient::reply_length(const Request& request, size_t offset) const
+{
+    auto reader = Reader(std::string_view(_received).substr(offset));
+    auto arguments = Reader(request.arguments());
+    auto command = request.command();
+
+    if (command == Command::GetMasterBlock)
+    {
+        reader.u32();
+        reader.u32();
+        reader.string();
+        reader.string();
+        return reader.exhausted() ? 0u : reader.position();
+    }
+    if (command == Command::ListFiles)
+    {
+        reader.bytes(reader.u8() * sizeof(uint16_t));
+        return reader.exhausted() ? 0u : reader.position();
+    }
+
+    auto status = static_cast<Status>(reader.u8());
+    if (reader.exhausted())
+        return 0u;
+    // Compact reports its progress after an error too, but not after bad arguments
+    if (command == Command::Compact && status != Status::Fail)
+        reader.u8();
+    if (status != Status::OK)
+        return reader.exhausted() ? 0u : reader.position();
+
+    switch (command)
+    {
+        case Command::ReadFile:
+            reader.string();
+            reader.string();
+            reader.string();
+            break;
+        case Command::GetFileName:
+        case Command::ReadField:
+            reader.string();
+            break;
+        case Command::GetStats:
+            reader.bytes(stats_counters * sizeof(uint32_t));
+            reader.bytes(reader.u8() * (sizeof(uint16_t) + 2u * sizeof(uint32_t)));
+            break;
+        case Command::SetFlowControl:
+            reader.u16();
+            reader.u16();
+            break;
+        case Command::SetPipelining:
+            reader.u16();
+            break;
+        case Command::DumpImage:
+            if (arguments.u8() == 1u)
+            {
+                while (!reader.exhausted() && reader.u16() != end_of_inodes)
+                    reader.bytes(inode_size);
+            }
+            else
+                reader.bytes(reader.u32());
+            reader.u32();
+            break;
+        case Command::GetPageWrites:
+            arguments.u16();
+            reader.u16();
+            reader.bytes(arguments.u16() * sizeof(uint16_t));
+            break;
+        case Command::DumpTrace:
+        {
+            auto count = reader.u16();
+            reader.u32();
+            reader.bytes(count * trace_event_size);
+            break;
+        }
+        case Command::RunBenchmark:
+            reader.bytes(benchmark_result_size);
+            break;
+        default:
+            break;
+    }
+    return reader.exhausted() ? 0u : reader.position();
+}
+
+either<size_t, ClientError> BluefishClient::receive_reply(const Request& request, size_t offset)
+{
+    auto has_status = request.command() != Command::ListFiles && request.command() != Command::GetMasterBlock;
+    while (true)
+    {
+        // With flow control on, grants can arrive until the reply starts; no status is 5
+        while (!_pipelined && has_status && _received.size() > offset
+                && _received[offset] == static_cast<char>(Status::Credit))
+            _received.erase(offset, 1u);
+
+        if (_received.size() > offset)
+        {
+            auto length = reply_length(request, offset);
+            if (length > 0u)
+                return length;
+        }
+
+        auto error = ClientError::Protocol;
+        if (failed(receive_more(), error))
+            return error;
+    }
+}
+
+either<bool, ClientError> BluefishClient::wait_for_tag(size_t offset, uint8_t tag)
+{
+    while (_received.size() <= offset)
+    {
+        auto error = ClientError::Protocol;
+        if (failed(receive_more(), error))
+            return error;
+    }
+
+    if (static_cast<uint8_t>(_received[offset]) != tag)
+        return ClientError::Protocol;
+    _received.erase(offset, 1u);
+    return true;
+}
+
+either<bool, ClientError> BluefishClient::send_request(const Request& request, size_t offset)
+{
+    auto message = std::string();
+    if (_pipelined)
+    {
+        auto length = static_cast<uint16_t>(1u + request.arguments().size());
+        message.push_back(static_cast<char>(_next_tag++));
+        message.push_back(static_cast<char>(length));
+        message.push_back(static_cast<char>(length >> 8u));
+        message.push_back(static_cast<char>(request.command()));
+        message.append(request.arguments());
+        return send_bytes(message);
+    }
+
+    auto error = ClientError::Protocol;
+    if (failed(wait_for_ready(offset), error))
+        return error;
+
+    message.push_back(static_cast<char>(request.command()));
+    message.append(request.arguments());
+    return send_bytes(message);
+}
+
+either<std::vector<BluefishClient::Reply>, ClientError> BluefishClient::send(const std::vector<Request>& requests)
+{
+    auto frame_size = [] (const Request& request) {
+        return frame_header_size + 1u + request.arguments().size();
+    };
+    for (const auto& request : requests)
+    {
+        if (request.command() == Command::SetBaudRate)
+            return ClientError::Protocol;
+        if (_pipelined && (frame_size(request) > _window || frame_size(request) - frame_header_size > 0xFFFFu))
+            return ClientError::TooLarge;
+    }
+
+    // Replies are kept where they land, so drop only those of the last batch; anything
+    // after them, such as a Ready, belongs to this one
+    _received.erase(0u, _consumed);
+    _consumed = 0u;
+
+    auto spans = std::vector<std::pair<size_t, size_t>>();
+    auto sent = size_t(0u);
+    auto in_flight = size_t(0u);
+    auto first_tag = _next_tag;
+    auto error = ClientError::Protocol;
+    for (auto answered = size_t(0u); answered < requests.size(); answered++)
+    {
+        // Pipelined, requests go out while the unanswered ones fit in the receive buffer;
+        // each reply means its whole request has been consumed
+        while (sent < requests.size()
+                && (_pipelined ? in_flight + frame_size(requests[sent]) <= _window : sent == answered))
+        {
+            if (failed(send_request(requests[sent], _consumed), error))
+                return error;
+            in_flight += frame_size(requests[sent]);
+            sent++;
+        }
+
+        if (_pipelined && failed(wait_for_tag(_consumed, static_cast<uint8_t>(first_tag + answered)), error))
+            return error;
+
+        auto length = size_t(0u);
+        auto received = receive_reply(requests[answered], _consumed).match(
+            [&length] (size_t reply_length) { length = reply_length; return true; },
+            [&error] (ClientError reason) { error = reason; return false; });
+        if (!received)
+            return error;
+
+        spans.emplace_back(_consumed, length);
+        _consumed += length;
+        in_flight -= frame_size(requests[answered]);
+    }
+
+    auto replies = std::vector<Reply>();
+    for (auto index = size_t(0u); index < requests.size(); index++)
+        replies.emplace_back(requests[index].command(),
+            std::string_view(_received).substr(spans[index].first, spans[index].second));
+    return replies;
+}
+
+either<BluefishClient::Reply, ClientError> BluefishClient::call(const Request& request)
+{
+    auto reply = Reply(request.command(), {});
+    auto error = ClientError::Protocol;
+    auto ok = send({ request }).match(
+        [&reply] (std::vector<Reply>& replies) { reply = replies[0]; return true; },
+        [&error] (ClientError reason) { error = reason; return false; });
+    if (!ok)
+        return error;
+    return reply;
+}
+
+either<bool, ClientError> BluefishClient::set_pipelining(bool enabled)
+{
+    auto error = ClientError::Protocol;
+    auto window = uint16_t(0u);
+    auto ok = call(Request(Command::SetPipelining).u8(enabled ? 1u : 0u)).match(
+        [&window] (Reply& reply) { window = reply.reader().u16(); return reply.ok(); },
+        [&error] (ClientError reason) { error = reason; return false; });
+    if (!ok)
+        return error;
+
+    // Tags restart so a reply can always be matched to this client's requests
+    _pipelined = enabled;
+    _window = window;
+    _next_tag = 0u;
+    return true;
+}
+
+BluefishClient::FileRecord BluefishClient::parse_file(Reader& reader)
+{
+    auto file = FileRecord();
+    file.name = reader.string();
+    file.username = reader.string();
+    file.password = reader.string();
+    return file;
+}
+
+BluefishClient::MasterBlock BluefishClient::parse_master_block(Reader& reader)
+{
+    auto block = MasterBlock();
+    block.free_inodes = reader.u32();
+    block.file_headers = reader.u32();
+    block.encryption_iv = reader.string();
+    block.challenge = reader.string();
+    return block;
+}
+
+std::vector<uint16_t> BluefishClient::parse_file_ids(Reader& reader)
+{
+    auto ids = std::vector<uint16_t>(reader.u8());
+    for (auto& id : ids)
+        id = reader.u16();
+    return ids;
+}
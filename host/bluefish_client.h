@@ -0,0 +1,217 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <either.h>
+
+// Talks the device's binary protocol, as laid out in the README, over any file descriptor:
+// a serial port, or the pty of bluefish-standin. Independent of the firmware sources, so it
+// can be lifted into other host software.
+//
+// In pipelined mode send() sends a whole batch ahead, keeping the unanswered requests
+// within the device's receive buffer, and parses the replies where they landed. The
+// strings a Reply hands out are views into the client's buffer, valid until the next
+// send() or call().
+
+enum class ClientError
+{
+    // Nothing arrived within the timeout
+    Timeout,
+    // The descriptor was closed or failed
+    Disconnected,
+    // A request that does not fit in a frame or the receive buffer
+    TooLarge,
+    // A reply that does not parse, or a tag out of order
+    Protocol
+};
+
+class BluefishClient
+{
+    public:
+        enum class Command : uint8_t
+        {
+            WriteFile = 1u,
+            ReadFile,
+            GetMasterBlock,
+            ListFiles,
+            RemoveFile,
+            Format,
+            GetFileName,
+            GetStats,
+            SetFlowControl,
+            SetBaudRate,
+            DumpImage,
+            RestoreImage,
+            Compact,
+            GetPageWrites,
+            ReadField,
+            DumpTrace,
+            RunBenchmark,
+            SetPipelining
+        };
+
+        enum class Status : uint8_t
+        {
+            OK = 0u,
+            Fail,
+            NotEnoughDiskSpace,
+            FileNotFound,
+            Ready,
+            Credit
+        };
+
+        enum class Field : uint8_t
+        {
+            Name = 0u,
+            Username,
+            Password
+        };
+
+        // A command and its little endian arguments
+        class Request
+        {
+            private:
+                Command _command;
+                std::string _arguments;
+
+            public:
+                explicit Request(Command command)
+                    : _command(command),
+                    _arguments()
+                {}
+
+                Request& u8(uint8_t value);
+                Request& u16(uint16_t value);
+                Request& u32(uint32_t value);
+                // A u16 length and the bytes
+                Request& string(std::string_view value);
+                Request& bytes(std::string_view value);
+
+                Command command() const;
+                const std::string& arguments() const;
+        };
+
+        // Parses little endian values out of a reply in place. Reading past the end yields
+        // zeros and empty views and marks the reader exhausted.
+        class Reader
+        {
+            private:
+                std::string_view _data;
+                size_t _position;
+                bool _exhausted;
+
+            public:
+                explicit Reader(std::string_view data)
+                    : _data(data),
+                    _position(0u),
+                    _exhausted(false)
+                {}
+
+                uint8_t u8();
+                uint16_t u16();
+                uint32_t u32();
+                std::string_view string();
+                std::string_view bytes(size_t size);
+
+                size_t position() const;
+                bool exhausted() const;
+        };
+
+        class Reply
+        {
+            private:
+                Command _command;
+                std::string_view _body;
+
+            public:
+                Reply(Command command, std::string_view body)
+                    : _command(command),
+                    _body(body)
+                {}
+
+                Command command() const;
+                // The reply after its tag, status byte included
+                std::string_view body() const;
+                // Commands whose replies carry no status, ListFiles and GetMasterBlock, read
+                // as OK
+                Status status() const;
+                bool ok() const;
+                // A reader positioned after the status byte
+                Reader reader() const;
+        };
+
+        struct FileRecord
+        {
+            std::string_view name;
+            std::string_view username;
+            std::string_view password;
+        };
+
+        struct MasterBlock
+        {
+            uint32_t free_inodes;
+            uint32_t file_headers;
+            std::string_view encryption_iv;
+            std::string_view challenge;
+        };
+
+    private:
+        int _fd;
+        int _timeout_ms;
+        bool _pipelined;
+        uint16_t _window;
+        uint8_t _next_tag;
+        std::string _received;
+
+        // Replies of the last send() occupy _received up to here
+        size_t _consumed;
+
+        either<bool, ClientError> send_bytes(const std::string& data);
+        // Appends whatever arrives within the timeout to _received
+        either<bool, ClientError> receive_more();
+        // Drops everything from offset up to and including the next Ready
+        either<bool, ClientError> wait_for_ready(size_t offset);
+        either<bool, ClientError> wait_for_tag(size_t offset, uint8_t tag);
+        either<bool, ClientError> send_request(const Request& request, size_t offset);
+        // Bytes of _received from offset that make up one whole reply to request, or 0 if more
+        // are needed. Replies whose status is not OK end after it, except Compact's.
+        size_t reply_length(const Request& request, size_t offset) const;
+        either<size_t, ClientError> receive_reply(const Request& request, size_t offset);
+
+    public:
+        static constexpr int default_timeout_ms = 5000;
+
+        // Uses fd as it is; see open_serial() for a port that needs configuring
+        explicit BluefishClient(int fd)
+            : _fd(fd),
+            _timeout_ms(default_timeout_ms),
+            _pipelined(false),
+            _window(0u),
+            _next_tag(0u),
+            _received(),
+            _consumed(0u)
+        {}
+
+        // Opens a serial device raw at 115200 baud; -1 on failure
+        static int open_serial(const char* path);
+
+        void set_timeout(int timeout_ms);
+        bool pipelined() const;
+
+        // Switches pipelining, remembering the receive buffer size it reports
+        either<bool, ClientError> set_pipelining(bool enabled);
+
+        // Sends every request and returns their replies in order. Pipelined, the requests go
+        // ahead of their replies; otherwise each waits for Ready. SetBaudRate needs the port
+        // switched between its two replies and is refused.
+        either<std::vector<Reply>, ClientError> send(const std::vector<Request>& requests);
+        either<Reply, ClientError> call(const Request& request);
+
+        static FileRecord parse_file(Reader& reader);
+        static MasterBlock parse_master_block(Reader& reader);
+        static std::vector<uint16_t> parse_file_ids(Reader& reader);
+};
@@ -0,0 +1,486 @@
+// bluefish-image: inspects and maintains DumpImage backups on a host, running the
+// firmware's own FileSystem over a memory mapped copy of the image
+#include <stdio.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#include "file_record.h"
+#include "file_system.h"
+#include "mapped_image.h"
+#include "shared_string.h"
+
+static int usage()
+{
+    fprintf(stderr,
+        "usage: bluefish-image <command> <image> [arguments]\n"
+        "  info <image>              master block and journal state\n"
+        "  list <image>              file ids and names\n"
+        "  read <image> <name>       one file's fields\n"
+        "  verify <image>            checks chains, the string table and the counts\n"
+        "  compact <image>           compacts the image in place\n"
+        "  rewrite <image> <output>  writes every file into a freshly formatted copy\n"
+        "Only compact writes to <image>; the other commands mount a private copy.\n");
+    return 2;
+}
+
+static void print_escaped(const CharString& value)
+{
+    for (auto i = 0u; i < value.length(); i++)
+    {
+        auto c = static_cast<uint8_t>(value.data()[i]);
+        if (c >= 0x20u && c < 0x7Fu && c != '\\')
+            putchar(c);
+        else
+            printf("\\x%02x", c);
+    }
+}
+
+static inode_t inode_count(const MappedImage& image)
+{
+    auto count = image.size / INODE_SIZE;
+    return static_cast<inode_t>(count < 0xFFFFul ? count : 0xFFFFul);
+}
+
+static std::unique_ptr<MappedImage> open_image(const char* path, MappedImage::Access access)
+{
+    auto image = std::make_unique<MappedImage>(path, access);
+    if (!image->is_open() || image->size < 2u * INODE_SIZE)
+    {
+        fprintf(stderr, "%s: cannot map an image\n", path);
+        return nullptr;
+    }
+    return image;
+}
+
+// One inode as stored, read without mounting so nothing is recovered first
+struct RawInode
+{
+    inode_t next;
+    Flags flags;
+    // The whole inode, header included
+    CharString bytes;
+    // The piece of a record a chain member carries
+    CharString chain_data;
+    // The count a string table entry keeps; the same bytes as chain_data's length
+    uint16_t references;
+};
+
+static RawInode read_raw_inode(const MappedImage& image, inode_t inode)
+{
+    auto raw = RawInode();
+    raw.bytes = image.read(static_cast<address_t>(inode) * INODE_SIZE, INODE_SIZE);
+    auto reader = istream(&raw.bytes);
+    decode_inode_header(reader, raw.next, raw.flags);
+
+    auto body = reader.tellg();
+    auto length = CharString::length_prefix_t(0u);
+    reader >> length;
+    if (length <= usable_inode_space - sizeof(length))
+        raw.chain_data = raw.bytes.read(reader.tellg(), length);
+
+    reader.seekg(body);
+    reader >> raw.references;
+    return raw;
+}
+
+// The master state follows the master block's strings, wherever they end
+static FSMasterState read_master_state(const MappedImage& image)
+{
+    auto bytes = image.read(0u, INODE_SIZE);
+    auto reader = istream(&bytes);
+    auto master = FSMasterINode();
+    auto state = FSMasterState();
+    reader >> master >> state;
+    return state;
+}
+
+static int info(const char* path)
+{
+    auto image = open_image(path, MappedImage::Access::ReadOnly);
+    if (!image)
+        return 1;
+
+    auto master = read_raw_inode(*image, 0u);
+    printf("image        %u bytes, %u inodes\n", image->size, inode_count(*image));
+    printf("master       in use %u, version %u\n", master.flags.in_use, master.flags.version);
+    if (master.flags.relocating)
+        printf("journal      move of inode %u\n", master.next);
+    else if (master.flags.reclaiming)
+        printf("journal      reclaim of inode %u\n", master.next);
+    auto state = read_master_state(*image);
+    printf("cursor       inode %u\n", state.allocation_cursor);
+    printf("state        %s\n", state.clean ? "clean" : "dirty, recounted on mount");
+
+    auto fs = FileSystem(std::move(image));
+    const auto& block = fs.get_master_block();
+    printf("files        %u\n", block.file_headers);
+    printf("free inodes  %u\n", block.free_inodes);
+    printf("iv           %u bytes\n", block.encryption_iv.length());
+    printf("challenge    %u bytes\n", block.challenge.length());
+    return 0;
+}
+
+static int list(const char* path)
+{
+    auto image = open_image(path, MappedImage::Access::ReadOnly);
+    if (!image)
+        return 1;
+
+    auto fs = FileSystem(std::move(image));
+    for (const auto& id : fs.list_files())
+    {
+        printf("%5u  ", id.value);
+        fs.get_filename(id).match(
+            [] (const CharString& name) { print_escaped(name); },
+            [] (const FileSystemError&) { printf("<unreadable>"); });
+        putchar('\n');
+    }
+    return 0;
+}
+
+static int read_file(const char* path, const char* name)
+{
+    auto image = open_image(path, MappedImage::Access::ReadOnly);
+    if (!image)
+        return 1;
+
+    auto fs = FileSystem(std::move(image));
+    return fs.read(CharString(name)).match(
+        [] (const File& file)
+        {
+            printf("name      ");
+            print_escaped(file.name);
+            printf("\nusername  ");
+            print_escaped(file.username);
+            printf("\npassword  ");
+            print_escaped(file.password);
+            putchar('\n');
+            return 0;
+        },
+        [name] (const FileSystemError&)
+        {
+            fprintf(stderr, "%s: not found\n", name);
+            return 1;
+        });
+}
+
+// Walks every chain and table entry of an unmounted image. Problems are damage the
+// firmware will not repair; notes are states that mounting or compaction put right.
+class ImageCheck
+{
+    private:
+        const MappedImage& _image;
+        inode_t _count;
+        std::vector<RawInode> _inodes;
+        FSMasterState _state;
+        // The header whose chain claims each inode, or 0
+        std::vector<inode_t> _owner;
+        std::vector<uint16_t> _references;
+        unsigned int _problems;
+        unsigned int _notes;
+
+        void problem(inode_t inode, const char* message, unsigned int detail = 0u)
+        {
+            printf("problem  inode %u: ", inode);
+            printf(message, detail);
+            putchar('\n');
+            _problems++;
+        }
+
+        void note(inode_t inode, const char* message, unsigned int detail = 0u)
+        {
+            printf("note     inode %u: ", inode);
+            printf(message, detail);
+            putchar('\n');
+            _notes++;
+        }
+
+        // A removed header's chain may already be partly freed. Freed members keep their next
+        // and data, so the record still reads as the firmware's recovery reads it.
+        void check_chain(inode_t header, bool removed)
+        {
+            auto record = _inodes[header].chain_data;
+            auto next = _inodes[header].next;
+            for (auto steps = 1u; next != 0u; steps++)
+            {
+                if (next >= _count)
+                    return problem(header, "chain leaves the device at %u", next);
+                if (next == header || _owner[next] == header || steps >= _count)
+                    return problem(header, "chain loops back to inode %u", next);
+                if (_owner[next] != 0u)
+                    return problem(header, "chain shares inode %u with another file", next);
+
+                const auto& member = _inodes[next];
+                if (member.flags.in_use && (member.flags.is_file_header || member.flags.reclaiming))
+                    return problem(header, "chain runs into the header at %u", next);
+                if (member.flags.in_use && is_shared_string(member.flags))
+                    return problem(header, "chain runs into the string table entry at %u", next);
+                if (!member.flags.in_use && !removed)
+                    return problem(header, "chain reaches free inode %u", next);
+
+                if (member.flags.in_use)
+                    _owner[next] = header;
+                record += member.chain_data;
+                next = member.next;
+            }
+
+            // Removed files hold their reference until the chain is freed
+            check_record(header, record);
+        }
+
+        void check_record(inode_t header, const CharString& record)
+        {
+            auto table = FieldTable();
+            if (!read_field_table(record, table))
+                return;
+            if (table.record_length() > record.length())
+                return problem(header, "record is %u bytes short", table.record_length() - record.length());
+            if (!table.shared(FileField::Username))
+                return;
+
+            auto stored = record.read(table.offset(FileField::Username), table.length(FileField::Username));
+            if (stored.length() < sizeof(inode_t))
+                return problem(header, "username reference is truncated");
+
+            auto reader = istream(&stored);
+            auto reference = inode_t(0u);
+            reader >> reference;
+            if (reference == 0u || reference >= _count || !is_shared_string(_inodes[reference].flags))
+                return problem(header, "username refers to inode %u, which is not a string table entry", reference);
+            _references[reference]++;
+        }
+
+        void check_master()
+        {
+            const auto& master = _inodes[0];
+            if (!master.flags.in_use)
+                return note(0u, "master block is clear, so the image mounts empty");
+            if (master.flags.version != inode_format_version)
+                return note(0u, "written by format version %u, upgraded on mount", master.flags.version);
+
+            if (master.flags.relocating)
+                note(0u, "move of inode %u pending, finished on mount", master.next);
+            else if (master.flags.reclaiming && master.next < _count && _inodes[master.next].flags.in_use
+                    && _inodes[master.next].flags.reclaiming)
+                note(0u, "reclaim of inode %u pending, finished on mount", master.next);
+
+            if (_state.allocation_cursor >= _count)
+                problem(0u, "allocation cursor %u is past the end", _state.allocation_cursor);
+            if (!_state.clean)
+                note(0u, "not shut down cleanly, so counts are recounted and orphans freed on mount");
+        }
+
+    public:
+        ImageCheck(const MappedImage& image)
+            : _image(image),
+            _count(inode_count(image)),
+            _inodes(),
+            _state(read_master_state(image)),
+            _owner(_count),
+            _references(_count),
+            _problems(0u),
+            _notes(0u)
+        {
+            for (auto index = inode_t(0u); index < _count; index++)
+                _inodes.push_back(read_raw_inode(_image, index));
+        }
+
+        int run()
+        {
+            check_master();
+            if (!_inodes[0].flags.in_use || _inodes[0].flags.version != inode_format_version)
+                return finish();
+
+            auto free_inodes = 0u;
+            auto file_headers = 0u;
+            auto shared_strings = 0u;
+            for (auto index = inode_t(1u); index < _count; index++)
+            {
+                const auto& flags = _inodes[index].flags;
+                if (!flags.in_use)
+                {
+                    free_inodes++;
+                    continue;
+                }
+                if (flags.version != inode_format_version)
+                    problem(index, "in use with format version %u", flags.version);
+                if (flags.relocating && !_inodes[0].flags.relocating)
+                    problem(index, "marked relocating with no move journalled");
+                if (flags.is_file_header)
+                {
+                    file_headers++;
+                    check_chain(index, false);
+                }
+            }
+
+            // After every live chain, so a removed one is never blamed for sharing an inode
+            for (auto index = inode_t(1u); index < _count; index++)
+            {
+                const auto& flags = _inodes[index].flags;
+                if (flags.in_use && !flags.is_file_header && flags.reclaiming)
+                {
+                    note(index, "removed, chain not yet freed");
+                    check_chain(index, true);
+                }
+            }
+
+            for (auto index = inode_t(1u); index < _count; index++)
+            {
+                const auto& inode = _inodes[index];
+                if (!inode.flags.in_use || inode.flags.is_file_header || inode.flags.reclaiming
+                        || inode.flags.relocating || _owner[index] != 0u)
+                    continue;
+                if (!is_shared_string(inode.flags))
+                {
+                    if (_state.clean)
+                        problem(index, "in use but in no chain, on an image marked clean");
+                    else
+                        note(index, "in use but in no chain; left by an interrupted write, freed on mount");
+                    continue;
+                }
+
+                shared_strings++;
+                auto stored = inode.references;
+                if (_references[index] == 0u)
+                    note(index, "string table entry nothing refers to, freed by compaction");
+                else if (stored < _references[index])
+                    problem(index, "string table entry counts %u references too few", _references[index] - stored);
+                else if (stored > _references[index])
+                    note(index, "string table entry counts %u references too many, recounted by compaction",
+                        stored - _references[index]);
+            }
+
+            auto master = FSMasterINode();
+            auto reader = istream(&_inodes[0].bytes);
+            reader >> master;
+            auto stale = master.data.free_inodes != free_inodes || master.data.file_headers != file_headers;
+            if (stale && _state.clean)
+                problem(0u, "stored counts are stale on an image marked clean");
+            else if (stale)
+                note(0u, "stored counts are stale, recounted on mount");
+
+            printf("%u files, %u free inodes, %u string table entries\n", file_headers, free_inodes, shared_strings);
+            return finish();
+        }
+
+        int finish()
+        {
+            printf("%u problems, %u notes\n", _problems, _notes);
+            return (_problems == 0u) ? 0 : 1;
+        }
+};
+
+static int verify(const char* path)
+{
+    auto image = open_image(path, MappedImage::Access::ReadOnly);
+    if (!image)
+        return 1;
+    return ImageCheck(*image).run();
+}
+
+static int compact(const char* path)
+{
+    auto image = open_image(path, MappedImage::Access::ReadWrite);
+    if (!image)
+        return 1;
+
+    auto fs = FileSystem(std::move(image));
+    auto steps = 0ul;
+    for (auto done = false; !done; steps++)
+    {
+        auto failed = fs.compact_step().match(
+            [&done] (const CompactProgress& progress) { done = progress == CompactProgress::Complete; return false; },
+            [] (const FileSystemError&) { return true; });
+        if (failed)
+        {
+            fprintf(stderr, "%s: not enough free space to compact\n", path);
+            return 1;
+        }
+    }
+
+    fs.flush_master_block();
+    printf("compacted in %lu steps, %u write cycles\n", steps, fs.device_stats().write_cycles);
+    return 0;
+}
+
+static bool copy_file(const char* from, const char* to)
+{
+    auto in = fopen(from, "rb");
+    auto out = in ? fopen(to, "wb") : nullptr;
+    char buffer[4096];
+    auto ok = in && out;
+    for (auto read = size_t(0u); ok && (read = fread(buffer, 1u, sizeof(buffer), in)) > 0u;)
+        ok = fwrite(buffer, 1u, read, out) == read;
+    if (in)
+        fclose(in);
+    if (out && fclose(out) != 0)
+        ok = false;
+    return ok;
+}
+
+static int rewrite(const char* path, const char* output)
+{
+    auto source = open_image(path, MappedImage::Access::ReadOnly);
+    if (!source)
+        return 1;
+
+    auto files = std::vector<File>();
+    auto fs = FileSystem(std::move(source));
+    for (const auto& id : fs.list_files())
+        fs.read(id).match(
+            [&files] (File& file) { files.push_back(std::move(file)); },
+            [&id] (const FileSystemError&) { fprintf(stderr, "inode %u: unreadable, dropped\n", id.value); });
+    auto master = fs.get_master_block();
+
+    // Into a copy, so the same size and never over the only backup
+    if (!copy_file(path, output))
+    {
+        fprintf(stderr, "%s: cannot copy the image\n", output);
+        return 1;
+    }
+    auto target = open_image(output, MappedImage::Access::ReadWrite);
+    if (!target)
+        return 1;
+
+    auto rewritten = FileSystem(std::move(target));
+    rewritten.format(master.encryption_iv, master.challenge);
+    for (const auto& file : files)
+    {
+        auto failed = rewritten.write(file).match(
+            [] (const FileId&) { return false; },
+            [] (const FileSystemError&) { return true; });
+        if (failed)
+        {
+            fprintf(stderr, "%s: out of space\n", output);
+            return 1;
+        }
+    }
+
+    // write() leaves the counts for the next master block write; this makes it now
+    rewritten.flush_master_block();
+    printf("rewrote %zu files\n", files.size());
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+        return usage();
+
+    auto command = argv[1];
+    if (strcmp(command, "info") == 0 && argc == 3)
+        return info(argv[2]);
+    if (strcmp(command, "list") == 0 && argc == 3)
+        return list(argv[2]);
+    if (strcmp(command, "read") == 0 && argc == 4)
+        return read_file(argv[2], argv[3]);
+    if (strcmp(command, "verify") == 0 && argc == 3)
+        return verify(argv[2]);
+    if (strcmp(command, "compact") == 0 && argc == 3)
+        return compact(argv[2]);
+    if (strcmp(command, "rewrite") == 0 && argc == 4)
+        return rewrite(argv[2], argv[3]);
+    return usage();
+}
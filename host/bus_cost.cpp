@@ -0,0 +1,71 @@
+#include "bus_cost.h"
+
+void BusCost::add(const TraceEvent& event)
+{
+    switch (event.op)
+    {
+        case TraceOp::EEPROMRead:
+            reads++;
+            bytes_read += event.length;
+            break;
+        case TraceOp::EEPROMWrite:
+            writes++;
+            bytes_written += event.length;
+            break;
+        case TraceOp::SerialRead:
+            serial_read += event.length;
+            break;
+        case TraceOp::SerialWrite:
+            serial_written += event.length;
+            break;
+        case TraceOp::CommandStart:
+            break;
+        case TraceOp::CommandEnd:
+            commands++;
+            break;
+    }
+}
+
+BusCost& BusCost::operator+=(const BusCost& other)
+{
+    commands += other.commands;
+    reads += other.reads;
+    writes += other.writes;
+    bytes_read += other.bytes_read;
+    bytes_written += other.bytes_written;
+    serial_read += other.serial_read;
+    serial_written += other.serial_written;
+    return *this;
+}
+
+uint32_t BusCost::transactions() const
+{
+    return reads + writes;
+}
+
+uint64_t BusCost::uart_us() const
+{
+    // A start bit, eight data bits and a stop bit per byte
+    auto bits = 10ull * (serial_read + serial_written);
+    return bits * 1000000ull / SerialStream::default_baud_rate;
+}
+
+uint64_t BusCost::bus_us() const
+{
+    // Nine clocks per byte with its acknowledge. A read sends the control byte and word
+    // address, then the control byte again after a repeated start; a write sends them once.
+    // Starts and stops take about a clock each.
+    auto bits = reads * (9ull * (2u + address_bytes) + 3u) + writes * (9ull * (1u + address_bytes) + 2u)
+        + 9ull * (static_cast<uint64_t>(bytes_read) + bytes_written);
+    return bits * 1000000ull / I2C_CLOCK;
+}
+
+uint64_t BusCost::write_cycles_us() const
+{
+    return static_cast<uint64_t>(writes) * write_cycle_us;
+}
+
+uint64_t BusCost::modelled_us() const
+{
+    return uart_us() + bus_us() + write_cycles_us();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "i2c_eeprom.h"
+#include "serial_stream.h"
+#include "transaction_trace.h"
+#include "twi.h"
+
+// What a run of transaction trace events cost on the bus and the UART, summed from the
+// same events DumpTrace sends, so the counts mean the same as a board's
+struct BusCost
+{
+    uint32_t commands = 0u;
+    uint32_t reads = 0u;
+    uint32_t writes = 0u;
+    uint32_t bytes_read = 0u;
+    uint32_t bytes_written = 0u;
+    uint32_t serial_read = 0u;
+    uint32_t serial_written = 0u;
+
+    void add(const TraceEvent& event);
+    BusCost& operator+=(const BusCost& other);
+
+    // Each EEPROM write event is one page, and so one write cycle
+    uint32_t transactions() const;
+
+    // Time modelled for a 24LC512 on an I2C_CLOCK bus and a UART at the default baud rate.
+    // The parts are added up, so the firmware overlapping write cycles with reception is
+    // not credited and the total is an upper bound.
+    static constexpr uint32_t write_cycle_us = 5000u;
+    static constexpr uint8_t address_bytes = EEPROM_24LC512::address_bytes;
+    uint64_t uart_us() const;
+    uint64_t bus_us() const;
+    uint64_t write_cycles_us() const;
+    uint64_t modelled_us() const;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+// Just enough of the Arduino core for the firmware sources to build on a host
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+
+inline void* memcpy_P(void* destination, const void* source, size_t size)
+{
+    return memcpy(destination, source, size);
+}
+
+void delay(unsigned long ms);
+unsigned long millis();
+unsigned long micros();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+// Defined by the sketch
+void yield();
+
+// The UART on a host is whatever file descriptor is attached, such as the master side of
+// a pty, or a file to read and another to write. Baud rates are ignored.
+class HardwareSerial
+{
+    private:
+        int _input;
+        int _output;
+        int _capture;
+        void (*_end_of_input)();
+        uint8_t _received[256];
+        size_t _start;
+        size_t _end;
+        // Empty polls in a row; past idle_polls each one waits a millisecond for input
+        uint16_t _empty_polls;
+        static constexpr uint16_t idle_polls = 1000u;
+
+    public:
+        HardwareSerial()
+            : _input(-1),
+            _output(-1),
+            _capture(-1),
+            _end_of_input(nullptr),
+            _received(),
+            _start(0u),
+            _end(0u),
+            _empty_polls(0u)
+        {}
+
+        void attach(int fd);
+        void attach(int input, int output);
+        // Copies every byte received to fd as well, so a session can be replayed later
+        void capture(int fd);
+        // Called by each read that finds the input at its end, as a file is once read through
+        void at_end_of_input(void (*handler)());
+
+        void begin(unsigned long baud);
+        void end();
+        // Once the line has been quiet for a while, waits up to a millisecond for input, so
+        // the sketch's polling loops do not spin a host core while idle
+        int available();
+        int read();
+        size_t write(uint8_t value);
+        size_t write(const char* data, size_t size);
+        void flush();
+
+        explicit operator bool() const;
+};
+
+extern HardwareSerial Serial;
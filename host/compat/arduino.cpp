@@ -0,0 +1,119 @@
+#include <Arduino.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial;
+
+static const auto started = std::chrono::steady_clock::now();
+
+template <typename Duration>
+static unsigned long since_start()
+{
+    return static_cast<unsigned long>(
+        std::chrono::duration_cast<Duration>(std::chrono::steady_clock::now() - started).count());
+}
+
+void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+unsigned long millis()
+{
+    return since_start<std::chrono::milliseconds>();
+}
+
+unsigned long micros()
+{
+    return since_start<std::chrono::microseconds>();
+}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+
+void HardwareSerial::attach(int fd)
+{
+    attach(fd, fd);
+}
+
+void HardwareSerial::attach(int input, int output)
+{
+    _input = input;
+    _output = output;
+    _start = _end = 0u;
+    _empty_polls = 0u;
+}
+
+void HardwareSerial::capture(int fd)
+{
+    _capture = fd;
+}
+
+void HardwareSerial::at_end_of_input(void (*handler)())
+{
+    _end_of_input = handler;
+}
+
+void HardwareSerial::begin(unsigned long) {}
+void HardwareSerial::end() {}
+
+int HardwareSerial::available()
+{
+    if (_start == _end && _input >= 0)
+    {
+        auto waiting = pollfd{ _input, POLLIN, 0 };
+        auto timeout_ms = (_empty_polls < idle_polls) ? 0 : 1;
+        if (poll(&waiting, 1, timeout_ms) == 1 && (waiting.revents & POLLIN))
+        {
+            auto received = ::read(_input, _received, sizeof(_received));
+            _start = 0u;
+            _end = (received > 0) ? static_cast<size_t>(received) : 0u;
+            if (received > 0 && _capture >= 0 && ::write(_capture, _received, _end) < 0)
+                _capture = -1;
+            if (received == 0 && _end_of_input != nullptr)
+                _end_of_input();
+        }
+        if (_start != _end)
+            _empty_polls = 0u;
+        else if (_empty_polls < idle_polls)
+            _empty_polls++;
+    }
+    return static_cast<int>(_end - _start);
+}
+
+int HardwareSerial::read()
+{
+    if (available() == 0)
+        return -1;
+    return _received[_start++];
+}
+
+size_t HardwareSerial::write(uint8_t value)
+{
+    return write(reinterpret_cast<const char*>(&value), 1u);
+}
+
+size_t HardwareSerial::write(const char* data, size_t size)
+{
+    for (auto written = size_t(0u); written < size && _output >= 0;)
+    {
+        auto sent = ::write(_output, data + written, size - written);
+        if (sent > 0)
+            written += static_cast<size_t>(sent);
+        else if (sent < 0 && errno != EINTR && errno != EAGAIN)
+            return written;
+    }
+    return size;
+}
+
+void HardwareSerial::flush() {}
+
+HardwareSerial::operator bool() const
+{
+    return _input >= 0;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// The STL library's header names, mapped onto the host standard library
+#include <type_traits>
@@ -0,0 +1,219 @@
+// bluefish-compression-bench: measures what record compression saves and costs, running the
+// firmware's own encode_record() and decode_field() over a corpus of credentials. Prints a
+// tab separated header and one line per corpus, so runs can be compared by a script:
+//
+//   bluefish-compression-bench [records.tsv]
+//
+// A corpus file holds one credential per line as name, username and password separated by
+// tabs. Times are host microseconds per record; they rank encoder changes against each other,
+// not against an AVR's clock.
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "char_string.h"
+#include "file.h"
+#include "file_record.h"
+#include "inode.h"
+#include "record_compression.h"
+
+// The firmware's idle hook, which nothing here waits in
+void yield() {}
+
+// Each timing is repeated this often and averaged, as a single record takes microseconds
+static constexpr unsigned int repeats = 200u;
+// The piece of a record each inode of a chain carries, as FileSystem::write() splits it
+static constexpr unsigned int inode_data_size = usable_inode_space - sizeof(CharString::length_prefix_t);
+
+struct CorpusResult
+{
+    unsigned long records = 0ul;
+    unsigned long plain_bytes = 0ul;
+    unsigned long stored_bytes = 0ul;
+    unsigned long plain_inodes = 0ul;
+    unsigned long stored_inodes = 0ul;
+    unsigned long compressed_fields = 0ul;
+    double encode_us = 0.0;
+    double decode_us = 0.0;
+    double max_encode_us = 0.0;
+    unsigned long round_trip_failures = 0ul;
+};
+
+static unsigned long inodes_for(unsigned long length)
+{
+    return (length + inode_data_size - 1u) / inode_data_size;
+}
+
+static CharString from_text(const char* text, size_t length)
+{
+    auto value = CharString(static_cast<unsigned int>(length));
+    memcpy(value.data(), text, length);
+    return value;
+}
+
+static CharString from_text(const char* text)
+{
+    return from_text(text, strlen(text));
+}
+
+static const CharString& field_of(const File& file, FileField field)
+{
+    return (field == FileField::Name) ? file.name
+        : (field == FileField::Username) ? file.username : file.password;
+}
+
+// Stands in for a typical user's vault: a few accounts spread over common sites, with
+// generated passwords that no coder can shrink
+static std::vector<File> builtin_corpus()
+{
+    static const char* const sites[] = {
+        "accounts.google.com", "mail.google.com", "github.com", "gitlab.com",
+        "www.amazon.com", "www.amazon.co.uk", "login.microsoftonline.com", "outlook.live.com",
+        "www.facebook.com", "twitter.com", "www.linkedin.com", "www.reddit.com",
+        "store.steampowered.com", "www.netflix.com", "www.paypal.com", "online.bank.example.com",
+        "id.apple.com", "www.dropbox.com", "slack.com", "app.example.org",
+        "forum.example.net", "shop.example.com", "portal.example.co.uk", "wiki.example.org"
+    };
+    static const char* const usernames[] = {
+        "alice@example.com", "alice.work@example.org", "alice", "a.liddell@mail.example.net"
+    };
+
+    auto random = uint32_t(1u);
+    auto corpus = std::vector<File>();
+    for (auto site = 0u; site < sizeof(sites) / sizeof(sites[0]); site++)
+        for (auto user = 0u; user < sizeof(usernames) / sizeof(usernames[0]); user++)
+        {
+            auto password = CharString(16u);
+            for (auto i = 0u; i < password.length(); i++)
+            {
+                random ^= random << 13u;
+                random ^= random >> 17u;
+                random ^= random << 5u;
+                password.data()[i] = static_cast<char>('!' + random % 94u);
+            }
+            corpus.push_back(File(from_text(sites[site]), from_text(usernames[user]), std::move(password)));
+        }
+    return corpus;
+}
+
+static bool read_corpus(const char* path, std::vector<File>& corpus)
+{
+    auto* input = fopen(path, "r");
+    if (input == nullptr)
+    {
+        perror(path);
+        return false;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), input) != nullptr)
+    {
+        auto length = strcspn(line, "\r\n");
+        line[length] = '\0';
+        auto* username = strchr(line, '\t');
+        auto* password = (username != nullptr) ? strchr(username + 1, '\t') : nullptr;
+        if (password == nullptr)
+            continue;
+
+        corpus.push_back(File(
+            from_text(line, static_cast<size_t>(username - line)),
+            from_text(username + 1, static_cast<size_t>(password - username - 1)),
+            from_text(password + 1)));
+    }
+    fclose(input);
+    return true;
+}
+
+template <typename TAction>
+static double time_us(TAction action)
+{
+    auto started = std::chrono::steady_clock::now();
+    for (auto i = 0u; i < repeats; i++)
+        action();
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / repeats;
+}
+
+static CorpusResult measure(const std::vector<File>& corpus)
+{
+    auto result = CorpusResult();
+    for (const auto& file : corpus)
+    {
+        auto plain = static_cast<unsigned long>(FieldTable::size + file.name.length()
+            + file.username.length() + file.password.length());
+        auto stored = encode_record(file, 0u);
+        auto table = FieldTable();
+        if (stored.length() == 0u || !read_field_table(stored, table))
+        {
+            result.round_trip_failures++;
+            continue;
+        }
+
+        result.records++;
+        result.plain_bytes += plain;
+        result.stored_bytes += stored.length();
+        result.plain_inodes += inodes_for(plain);
+        result.stored_inodes += inodes_for(stored.length());
+
+        auto encode_us = time_us([&] { encode_record(file, 0u); });
+        result.encode_us += encode_us;
+        if (encode_us > result.max_encode_us)
+            result.max_encode_us = encode_us;
+
+        CharString fields[file_field_count];
+        for (auto index = 0u; index < file_field_count; index++)
+        {
+            auto field = static_cast<FileField>(index);
+            fields[index] = stored.read(table.offset(field), table.length(field));
+            if (table.compressed(field))
+                result.compressed_fields++;
+            if (decode_field(table, field, fields[index]) != field_of(file, field))
+                result.round_trip_failures++;
+        }
+        result.decode_us += time_us([&] {
+            for (auto index = 0u; index < file_field_count; index++)
+                decode_field(table, static_cast<FileField>(index), fields[index]);
+        });
+    }
+    return result;
+}
+
+static void print(const char* corpus, const CorpusResult& result)
+{
+    auto records = (result.records > 0ul) ? static_cast<double>(result.records) : 1.0;
+    printf("%s\t%lu\t%lu\t%lu\t%.3f\t%.3f\t%lu\t%.2f\t%.2f\t%.2f\t%lu\n",
+        corpus, result.records, result.plain_bytes, result.stored_bytes,
+        result.plain_inodes / records, result.stored_inodes / records, result.compressed_fields,
+        result.encode_us / records, result.max_encode_us, result.decode_us / records,
+        result.round_trip_failures);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "usage: bluefish-compression-bench [records.tsv]\n");
+        return 2;
+    }
+
+    printf("corpus\trecords\tplain_bytes\tstored_bytes\tplain_inodes_per_record"
+        "\tstored_inodes_per_record\tcompressed_fields\tencode_us\tmax_encode_us\tdecode_us"
+        "\tround_trip_failures\n");
+
+    auto result = measure(builtin_corpus());
+    print("builtin", result);
+    auto failed = result.round_trip_failures != 0ul;
+
+    if (argc > 1)
+    {
+        auto corpus = std::vector<File>();
+        if (!read_corpus(argv[1], corpus))
+            return 1;
+        result = measure(corpus);
+        print(argv[1], result);
+        failed = failed || result.round_trip_failures != 0ul;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+#include "mapped_image.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "transaction_trace.h"
+
+const char* MappedImage::default_path = "bluefish.img";
+MappedImage::Access MappedImage::default_access = MappedImage::Access::Create;
+
+static int open_image(const char* path, MappedImage::Access access)
+{
+    if (access == MappedImage::Access::ReadOnly)
+        return open(path, O_RDONLY);
+
+    auto fd = open(path, O_RDWR);
+    if (fd >= 0 || access != MappedImage::Access::Create)
+        return fd;
+
+    fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0 && ftruncate(fd, MappedImage::default_size) != 0)
+    {
+        close(fd);
+        unlink(path);
+        return -1;
+    }
+    return fd;
+}
+
+static uint32_t image_length(int fd)
+{
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) != 0 || status.st_size <= 0 || status.st_size > 0xFFFFFFFFll)
+        return 0u;
+    return static_cast<uint32_t>(status.st_size);
+}
+
+MappedImage::MappedImage()
+    : MappedImage(default_path, default_access)
+{}
+
+MappedImage::MappedImage(const char* path, Access access)
+    : _fd(open_image(path, access)),
+    size(image_length(_fd)),
+    _data(nullptr),
+    _stats(),
+    _page_writes((size + page_size - 1u) / page_size)
+{
+    if (size == 0u)
+        return;
+
+    auto flags = (access == Access::ReadOnly) ? MAP_PRIVATE : MAP_SHARED;
+    auto mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, _fd, 0);
+    if (mapped != MAP_FAILED)
+        _data = static_cast<char*>(mapped);
+}
+
+MappedImage::~MappedImage()
+{
+    if (_data != nullptr)
+    {
+        msync(_data, size, MS_SYNC);
+        munmap(_data, size);
+    }
+    if (_fd >= 0)
+        close(_fd);
+}
+
+bool MappedImage::is_open() const
+{
+    return _data != nullptr;
+}
+
+void MappedImage::write(address_t address, const char* data, unsigned long size)
+{
+    if (!is_open())
+        return;
+
+    auto last_page = ~0ul;
+    for (auto i = 0ul; i < size; i++)
+    {
+        auto target = (address + i) % this->size;
+        _data[target] = data[i];
+
+        // One write cycle per page touched, as the drivers split writes at page boundaries
+        if (target / page_size != last_page)
+        {
+            last_page = target / page_size;
+            _stats.transactions++;
+            _stats.write_cycles++;
+            if (_page_writes[last_page] < 0xFFFFu)
+                _page_writes[last_page]++;
+#if TRANSACTION_TRACE
+            auto in_page = page_size - target % page_size;
+            transaction_trace.record(TraceOp::EEPROMWrite, target,
+                static_cast<uint16_t>((size - i < in_page) ? size - i : in_page));
+#endif
+        }
+    }
+    _stats.bytes_written += size;
+}
+
+CharString MappedImage::read(address_t address, unsigned long size) const
+{
+    auto result = CharString(size);
+    for (auto i = 0ul; i < size; i++)
+        result.data()[i] = is_open() ? _data[(address + i) % this->size] : '\0';
+
+    _stats.transactions++;
+    _stats.bytes_read += size;
+#if TRANSACTION_TRACE
+    transaction_trace.record(TraceOp::EEPROMRead, address % this->size, static_cast<uint16_t>(size));
+#endif
+    return result;
+}
+
+bool MappedImage::take_failure()
+{
+    return false;
+}
+
+uint16_t MappedImage::page_writes(address_t address) const
+{
+    return (address / page_size < _page_writes.size()) ? _page_writes[address / page_size] : 0u;
+}
+
+const DeviceStats& MappedImage::stats() const
+{
+    return _stats;
+}
+
+void MappedImage::reset_stats()
+{
+    _stats = DeviceStats();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include "address.h"
+#include "char_string.h"
+#include "readable.h"
+#include "writeable.h"
+#include "stats.h"
+
+// An image file mapped into memory, with the interface of the EEPROM drivers so the
+// firmware's FileSystem runs on it unchanged. Addresses past the end wrap, as they do on a
+// chip, and page writes are counted for the 128 byte pages of a 24LC512. Transactions are
+// recorded in the transaction trace as the driver would record them.
+class MappedImage : public IReadable, public IWriteable
+{
+    public:
+        enum class Access
+        {
+            // Writes land in a private copy and never reach the file
+            ReadOnly,
+            ReadWrite,
+            // As ReadWrite, creating a zero filled image of default_size if there is none;
+            // a zeroed master block mounts as an empty device awaiting Format
+            Create
+        };
+
+    private:
+        int _fd;
+
+    public:
+        const uint32_t size;
+
+    private:
+        char* _data;
+        mutable DeviceStats _stats;
+        std::vector<uint16_t> _page_writes;
+
+    public:
+        static constexpr uint16_t page_size = 128u;
+        static constexpr uint32_t default_size = 0x10000ul;
+        // The image MappedImage() opens or creates; bluefish-standin points it at its argument
+        static const char* default_path;
+        // How MappedImage() opens it; bluefish-replay works on a private copy
+        static Access default_access;
+
+        MappedImage();
+        MappedImage(const char* path, Access access);
+        ~MappedImage();
+
+        MappedImage(const MappedImage&) = delete;
+        MappedImage& operator=(const MappedImage&) = delete;
+
+        // False if the file could not be opened or mapped; size is then 0
+        bool is_open() const;
+
+        void write(address_t address, const char* data, unsigned long size) override;
+        CharString read(address_t address, unsigned long size) const override;
+
+        // An image never fails a transaction
+        bool take_failure();
+        uint16_t page_writes(address_t address) const;
+        const DeviceStats& stats() const;
+        void reset_stats();
+};
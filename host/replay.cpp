@@ -0,0 +1,160 @@
+// bluefish-replay: feeds a captured serial session to the firmware over a private copy of
+// an image and reports what each command cost on the bus, so a field workload can be
+// rerun against every firmware change:
+//
+//   bluefish-replay <image> <capture>
+//
+// A capture is the bytes a host sent, as bluefish-standin records them. The requests are
+// replayed back to back, so idle work only runs where the device finds nothing waiting,
+// and whatever idle work is left once the capture runs out is not replayed.
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <Arduino.h>
+
+#include "api.h"
+#include "binary_api.h"
+#include "bus_cost.h"
+#include "mapped_image.h"
+#include "transaction_trace.h"
+
+// The commands by number, as api.h lists them
+static const char* const command_names[] = {
+    "Unknown", "WriteFile", "ReadFile", "GetMasterBlock", "ListFiles", "RemoveFile", "Format",
+    "GetFileName", "GetStats", "SetFlowControl", "SetBaudRate", "DumpImage", "RestoreImage",
+    "Compact", "GetPageWrites", "ReadField", "DumpTrace", "RunBenchmark", "SetPipelining"
+};
+static_assert(sizeof(command_names) / sizeof(command_names[0]) == command_count,
+    "Every command needs a name");
+
+// Reads at the end of the capture since the last poll; a handler still waiting after this
+// many is stuck on a request the capture cut short
+static constexpr unsigned long stuck_reads = 100000ul;
+
+static BusCost per_command[command_count];
+static BusCost idle;
+static BusCost pending;
+static bool in_command = false;
+static bool input_ended = false;
+static unsigned long reads_at_end = 0ul;
+
+// The firmware's idle hook; the image never keeps the driver waiting
+void yield() {}
+
+static void print_row(const char* name, const BusCost& cost)
+{
+    printf("%s\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%llu\n", name, cost.commands,
+        cost.transactions(), cost.reads, cost.writes, cost.bytes_read, cost.bytes_written,
+        cost.serial_read, cost.serial_written, static_cast<unsigned long long>(cost.modelled_us()));
+}
+
+static void report()
+{
+    printf("command\tcount\ttransactions\treads\twrite_cycles\tbytes_read\tbytes_written"
+        "\tserial_read\tserial_written\tmodelled_us\n");
+    auto total = idle;
+    for (auto command = 0u; command < command_count; command++)
+    {
+        if (per_command[command].commands == 0u)
+            continue;
+        print_row(command_names[command], per_command[command]);
+        total += per_command[command];
+    }
+    print_row("idle", idle);
+    print_row("total", total);
+
+    if (transaction_trace.dropped() != 0u)
+        fprintf(stderr, "%u trace events were dropped; the counts are short\n", transaction_trace.dropped());
+}
+
+// Attributes the events of one poll to the command they fall in, or to idle work
+static bool drain_trace()
+{
+    auto commands_seen = false;
+    while (transaction_trace.size() > 0u)
+    {
+        auto event = transaction_trace.pop();
+        if (event.op == TraceOp::CommandStart)
+        {
+            idle += pending;
+            pending = BusCost();
+            in_command = true;
+            commands_seen = true;
+            continue;
+        }
+
+        pending.add(event);
+        if (event.op == TraceOp::CommandEnd)
+        {
+            // DumpTrace empties the trace itself, so its start may never be seen
+            auto command = (event.address < command_count) ? event.address : 0u;
+            per_command[command] += pending;
+            pending = BusCost();
+            in_command = false;
+            commands_seen = true;
+        }
+    }
+    if (!in_command)
+    {
+        idle += pending;
+        pending = BusCost();
+    }
+    return commands_seen;
+}
+
+static void end_of_input()
+{
+    input_ended = true;
+    if (++reads_at_end < stuck_reads)
+        return;
+
+    drain_trace();
+    report();
+    fprintf(stderr, "the capture ends part way through a request\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: bluefish-replay <image> <capture>\n"
+            "Replays the host bytes in <capture> against a private copy of <image> and prints\n"
+            "a tab separated line of bus and serial counts per command.\n");
+        return 2;
+    }
+
+    MappedImage::default_path = argv[1];
+    MappedImage::default_access = MappedImage::Access::ReadOnly;
+    if (!MappedImage().is_open())
+    {
+        fprintf(stderr, "%s: cannot map an image\n", argv[1]);
+        return 1;
+    }
+
+    auto capture = open(argv[2], O_RDONLY);
+    auto discard = open("/dev/null", O_WRONLY);
+    if (capture < 0 || discard < 0)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+    Serial.attach(capture, discard);
+    Serial.at_end_of_input(end_of_input);
+
+    auto api = BinaryAPI();
+    // Mounting is not part of the session
+    transaction_trace.clear();
+    while (true)
+    {
+        reads_at_end = 0ul;
+        api.poll();
+        if (!drain_trace() && input_ended)
+            break;
+    }
+
+    report();
+    return 0;
+}
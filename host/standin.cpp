@@ -0,0 +1,127 @@
+// bluefish-standin: runs the firmware sketch on a host, answering on a pty and keeping its
+// storage in an image file, so host software can be tried without the hardware
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <Arduino.h>
+
+#include "mapped_image.h"
+#include "twi.h"
+
+// The sketch's own entry points, from bluefish-firmware.ino
+void setup();
+void loop();
+
+// Only the EEPROM drivers use the bus, and the image stands in for them
+void TWI::begin(uint32_t) {}
+
+static int open_pty(const char* link)
+{
+    auto master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+        return -1;
+
+    // Raw, as a USB serial port is
+    struct termios settings;
+    if (tcgetattr(master, &settings) != 0)
+        return -1;
+    cfmakeraw(&settings);
+    tcsetattr(master, TCSANOW, &settings);
+
+    auto device = ptsname(master);
+    if (link != nullptr)
+    {
+        unlink(link);
+        if (symlink(device, link) != 0)
+            perror(link);
+    }
+    printf("listening on %s\n", link != nullptr ? link : device);
+    fflush(stdout);
+    return master;
+}
+
+// Output the last host left unread would otherwise reach the next one ahead of Ready. It
+// waits on the device side, which only that side can flush.
+static void discard_unread(int pty)
+{
+    tcflush(pty, TCIFLUSH);
+    auto device = open(ptsname(pty), O_RDWR | O_NOCTTY);
+    if (device < 0)
+        return;
+    tcflush(device, TCIFLUSH);
+    close(device);
+}
+
+// Whether a host has the other end of the pty open
+static bool connected(int pty)
+{
+    auto state = pollfd{ pty, 0, 0 };
+    return poll(&state, 1, 0) == 0 || !(state.revents & POLLHUP);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 4)
+    {
+        fprintf(stderr, "usage: bluefish-standin [image [link [capture]]]\n"
+            "Serves the image, %s by default, created empty if missing, on a new pty. A new\n"
+            "image mounts with no free space until it is sent Format. Everything hosts send is\n"
+            "written to capture, for bluefish-replay to rerun against a copy of the image as\n"
+            "it was at start.\n", MappedImage::default_path);
+        return 2;
+    }
+    if (argc > 1)
+        MappedImage::default_path = argv[1];
+
+    if (!MappedImage().is_open())
+    {
+        fprintf(stderr, "%s: cannot map an image\n", MappedImage::default_path);
+        return 1;
+    }
+
+    auto pty = open_pty(argc > 2 ? argv[2] : nullptr);
+    if (pty < 0)
+    {
+        perror("pty");
+        return 1;
+    }
+    if (argc > 3)
+    {
+        auto capture = open(argv[3], O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (capture < 0)
+        {
+            perror(argv[3]);
+            return 1;
+        }
+        Serial.capture(capture);
+    }
+
+    Serial.attach(pty);
+    setup();
+
+    // Restarts the sketch after each host leaves, as an UNO's auto reset does when the next
+    // one opens the port, so every host is greeted by a fresh Ready. A host that connects
+    // before the last one's leaving is seen finds the device idle and its Ready still queued.
+    auto host_seen = false;
+    while (true)
+    {
+        if (connected(pty))
+            host_seen = true;
+        else
+        {
+            if (host_seen)
+            {
+                discard_unread(pty);
+                Serial.attach(pty);
+                setup();
+                host_seen = false;
+            }
+            delay(10);
+        }
+        loop();
+    }
+}
@@ -0,0 +1,174 @@
+#include "twi_simulator.h"
+
+#include "twi.h"
+
+namespace
+{
+    struct Chip
+    {
+        std::vector<uint8_t> data;
+        // The address counter, as the block it was set in and the offset within that block
+        uint32_t block_start;
+        uint32_t offset;
+        uint8_t busy_polls;
+    };
+
+    struct Transaction
+    {
+        Chip* chip;
+        TWI::Direction direction;
+        uint32_t block_start;
+        uint8_t address_bytes_seen;
+        uint32_t word_address;
+        std::vector<uint8_t> written;
+    };
+
+    TWISimulator::Part bus_part = TWISimulator::part<EEPROM_24LC512>();
+    std::vector<Chip> chips;
+    TWISimulator::Counters bus_counters = {};
+    uint32_t failing_starts = 0u;
+    Transaction transaction = {};
+
+    // Bytes the word address reaches, which is all of a part too small to need block bits
+    uint32_t block_length()
+    {
+        auto block_size = 1ul << (8u * bus_part.address_bytes);
+        return (block_size < bus_part.capacity) ? block_size : bus_part.capacity;
+    }
+
+    bool decode(uint8_t address, Chip*& chip, uint32_t& block_start)
+    {
+        if ((address & 0x78u) != 0x50u)
+            return false;
+
+        auto select = address & 0x7u;
+        auto chip_index = (bus_part.scheme == BlockSelect::None) ? select
+            : (bus_part.scheme == BlockSelect::HighBit) ? (select & 0x3u) : 0u;
+        auto block = (bus_part.scheme == BlockSelect::LowBits) ? select
+            : (bus_part.scheme == BlockSelect::HighBit) ? (select >> 2) : 0u;
+
+        block_start = block * block_length();
+        if (chip_index >= chips.size() || block_start >= bus_part.capacity)
+            return false;
+        chip = &chips[chip_index];
+        return true;
+    }
+}
+
+void TWISimulator::attach(const Part& part, uint8_t count)
+{
+    bus_part = part;
+    chips.assign(count, Chip{ std::vector<uint8_t>(part.capacity, 0xFFu), 0u, 0u, 0u });
+    bus_counters = {};
+    failing_starts = 0u;
+    transaction = {};
+}
+
+void TWISimulator::fail_starts(uint32_t count)
+{
+    failing_starts = count;
+}
+
+std::vector<uint8_t>& TWISimulator::contents(uint8_t chip)
+{
+    return chips.at(chip).data;
+}
+
+const TWISimulator::Counters& TWISimulator::counters()
+{
+    return bus_counters;
+}
+
+void TWI::begin(uint32_t) {}
+
+bool TWI::start(uint8_t address, Direction direction)
+{
+    bus_counters.starts++;
+    transaction.chip = nullptr;
+
+    auto* chip = static_cast<Chip*>(nullptr);
+    auto block_start = uint32_t(0u);
+    if (failing_starts > 0u)
+        failing_starts--;
+    else if (decode(address, chip, block_start) && chip->busy_polls > 0u)
+    {
+        chip->busy_polls--;
+        chip = nullptr;
+    }
+
+    if (chip == nullptr)
+    {
+        bus_counters.unacknowledged++;
+        return false;
+    }
+
+    transaction = { chip, direction, block_start, 0u, 0u, {} };
+    if (direction == Direction::Read)
+        chip->block_start = block_start;
+    return true;
+}
+
+bool TWI::write(uint8_t data)
+{
+    if (transaction.chip == nullptr || transaction.direction != Direction::Write)
+        return false;
+
+    if (transaction.address_bytes_seen < bus_part.address_bytes)
+    {
+        transaction.word_address = (transaction.word_address << 8) | data;
+        if (++transaction.address_bytes_seen == bus_part.address_bytes)
+        {
+            transaction.chip->block_start = transaction.block_start;
+            transaction.chip->offset = transaction.word_address % block_length();
+        }
+        return true;
+    }
+
+    transaction.written.push_back(data);
+    return true;
+}
+
+bool TWI::write(const char* data, uint32_t size)
+{
+    for (auto i = 0ul; i < size; i++)
+        if (!write(static_cast<uint8_t>(data[i])))
+            return false;
+    return true;
+}
+
+uint8_t TWI::read(bool last)
+{
+    auto* chip = transaction.chip;
+    if (chip == nullptr || transaction.direction != Direction::Read)
+        return 0xFFu;
+
+    auto value = chip->data[chip->block_start + chip->offset];
+    if (++chip->offset == block_length())
+    {
+        chip->offset = 0u;
+        if (!last)
+            bus_counters.block_overruns++;
+    }
+    return value;
+}
+
+void TWI::stop()
+{
+    auto* chip = transaction.chip;
+    if (chip != nullptr && transaction.direction == Direction::Write && !transaction.written.empty())
+    {
+        // The page buffer takes the bytes from the word address on, wrapping at the page end
+        auto page_offset = chip->offset % bus_part.page_size;
+        auto page_start = chip->offset - page_offset;
+        if (transaction.written.size() > bus_part.page_size - page_offset)
+            bus_counters.page_overruns++;
+
+        for (auto i = 0ul; i < transaction.written.size(); i++)
+            chip->data[chip->block_start + page_start + (page_offset + i) % bus_part.page_size] = transaction.written[i];
+
+        chip->offset = page_start + (page_offset + transaction.written.size()) % bus_part.page_size;
+        chip->busy_polls = TWISimulator::write_cycle_polls;
+        bus_counters.write_cycles++;
+    }
+    transaction = {};
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "i2c_eeprom.h"
+
+// Stands in for twi.cpp with 24LC parts on a simulated bus, so the I2C_EEPROM driver can be
+// checked on a host. Each chip acts as its datasheet says: the device address picks the chip
+// and block, page writes wrap within their page, sequential reads wrap within their block and
+// starts go unacknowledged for a few polls after each write. A part would corrupt data
+// silently where the driver gets a split wrong, so the simulator counts those instead.
+class TWISimulator
+{
+    public:
+        struct Part
+        {
+            uint32_t capacity;
+            uint16_t page_size;
+            uint8_t address_bytes;
+            BlockSelect scheme;
+        };
+
+        struct Counters
+        {
+            uint32_t starts;
+            uint32_t unacknowledged;
+            uint32_t write_cycles;
+            // Write transactions with more data than the rest of their page
+            uint32_t page_overruns;
+            // Sequential reads that ran past the end of their block
+            uint32_t block_overruns;
+        };
+
+        // Starts a chip ignores while it is in a write cycle, standing in for the 5 ms a part takes
+        static constexpr uint8_t write_cycle_polls = 2u;
+
+        // Puts chips of the part on the bus, erased to 0xFF, and clears the counters
+        static void attach(const Part& part, uint8_t chips);
+        // The first count starts from now on are not acknowledged, as with noise on the bus
+        static void fail_starts(uint32_t count);
+
+        static std::vector<uint8_t>& contents(uint8_t chip);
+        static const Counters& counters();
+
+        template <typename TChip>
+        static constexpr Part part()
+        {
+            return { TChip::capacity, TChip::page_size, TChip::address_bytes, TChip::block_select };
+        }
+};
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "char_string.h"
+#include "readable.h"
+#include "stats.h"
+#include "transaction_trace.h"
+#include "twi.h"
+#include "writeable.h"
+
+// Override with -DPAGE_WRITE_COUNTERS=1 to count writes to each page in RAM for GetPageWrites
+#ifndef PAGE_WRITE_COUNTERS
+#define PAGE_WRITE_COUNTERS 0
+#endif
+
+// How address bits beyond the word address sent on the bus reach the chip
+enum class BlockSelect : uint8_t
+{
+    // The word address covers the chip; A2-A0 pick one of eight chips (24LC32 to 24LC512)
+    None = 0u,
+    // Address bits above the word address take the place of A2-A0, so there is one chip per bus (24LC16B)
+    LowBits,
+    // One block bit above A1-A0, which pick one of four chips (24LC1025)
+    HighBit
+};
+
+template <uint32_t Capacity, uint16_t PageSize, uint8_t AddressBytes, BlockSelect Scheme>
+class I2C_EEPROM : public IReadable, public IWriteable
+{
+    public:
+        static constexpr uint32_t capacity = Capacity;
+        static constexpr uint16_t page_size = PageSize;
+        static constexpr uint8_t address_bytes = AddressBytes;
+        static constexpr BlockSelect block_select = Scheme;
+        // Bytes reachable through the word address alone; sequential reads wrap within a block
+        static constexpr uint32_t block_size = 1ul << (8u * AddressBytes);
+        static constexpr uint8_t max_chips = (Scheme == BlockSelect::None)
+            ? 8u
+            : (Scheme == BlockSelect::HighBit) ? 4u : 1u;
+
+        static_assert(AddressBytes == 1u || AddressBytes == 2u, "I2C EEPROMs use one or two word address bytes");
+        static_assert(Capacity % PageSize == 0u && block_size % PageSize == 0u, "Pages must not straddle blocks");
+        static_assert(Scheme != BlockSelect::None || Capacity <= block_size, "Capacity needs a block select scheme");
+        static_assert(Scheme != BlockSelect::LowBits || Capacity <= block_size * 8u, "Only three low block bits");
+        static_assert(Scheme != BlockSelect::HighBit || Capacity <= block_size * 2u, "Only one high block bit");
+
+        static constexpr uint16_t bytes_to_page_end(address_t address)
+        {
+            return static_cast<uint16_t>(PageSize - (address % PageSize));
+        }
+
+        static constexpr uint32_t bytes_to_block_end(address_t address)
+        {
+            return block_size - (address % block_size);
+        }
+
+        static constexpr uint8_t device_address(uint8_t chip_select, address_t address)
+        {
+            return static_cast<uint8_t>(0x50u | (
+                (Scheme == BlockSelect::LowBits) ? ((address / block_size) & 0x7u)
+                : (Scheme == BlockSelect::HighBit) ? ((((address / block_size) & 0x1u) << 2) | (chip_select & 0x3u))
+                : (chip_select & 0x7u)));
+        }
+
+    private:
+        const uint8_t _chip_select;
+        const uint16_t write_cycle_ms = 30;
+        // Tries at a transaction the chip does not acknowledge before it is given up
+        static constexpr uint8_t max_attempts = 3u;
+
+        mutable DeviceStats _stats;
+        mutable bool _write_pending;
+        mutable unsigned long _write_started;
+        mutable bool _failed;
+#if PAGE_WRITE_COUNTERS
+        // Two bytes of RAM per page, so only for boards that can spare it
+        uint16_t _page_writes[Capacity / PageSize];
+#endif
+
+        bool acknowledges() const
+        {
+            auto acknowledged = TWI::start(device_address(_chip_select, 0u), TWI::Direction::Write);
+            TWI::stop();
+            _stats.transactions++;
+            return acknowledged;
+        }
+
+        void wait_until_ready() const
+        {
+            if (!_write_pending)
+                return;
+
+            auto wait_started = millis();
+            while (busy())
+                yield();
+            _stats.delay_ms += millis() - wait_started;
+        }
+
+        bool start(address_t address) const
+        {
+            if (!TWI::start(device_address(_chip_select, address), TWI::Direction::Write))
+                return false;
+            for (auto i = AddressBytes; i > 0u; i--)
+            {
+                if (!TWI::write(static_cast<uint8_t>((address >> ((i - 1u) * 8u)) & 0xFF)))
+                    return false;
+            }
+            return true;
+        }
+
+        // A chip still in a write cycle, or noise on the bus, leaves a byte unacknowledged.
+        // The chip may have taken part of a page, so wait out a write cycle before trying again.
+        void recover() const
+        {
+            TWI::stop();
+            _stats.errors++;
+            _write_pending = true;
+            _write_started = millis();
+            wait_until_ready();
+        }
+
+        void write_page(address_t address, const char* data, uint16_t size)
+        {
+            wait_until_ready();
+
+            auto written = false;
+            for (auto attempt = 0u; attempt < max_attempts && !written; attempt++)
+            {
+                if (attempt > 0u)
+                    recover();
+                written = start(address) && TWI::write(data, size);
+                _stats.transactions++;
+            }
+            TWI::stop();
+            _failed = _failed || !written;
+
+            _write_pending = true;
+            _write_started = millis();
+
+            _stats.bytes_written += size;
+            _stats.write_cycles++;
+#if PAGE_WRITE_COUNTERS
+            if (_page_writes[address / PageSize] < 0xFFFFu)
+                _page_writes[address / PageSize]++;
+#endif
+#if TRANSACTION_TRACE
+            transaction_trace.record(TraceOp::EEPROMWrite, address, size, _chip_select);
+#endif
+        }
+
+        void read_block(address_t address, char* data, uint32_t size) const
+        {
+            wait_until_ready();
+
+            auto addressed = false;
+            for (auto attempt = 0u; attempt < max_attempts && !addressed; attempt++)
+            {
+                if (attempt > 0u)
+                    recover();
+                addressed = start(address) && TWI::start(device_address(_chip_select, address), TWI::Direction::Read);
+                _stats.transactions++;
+            }
+
+            if (addressed)
+            {
+                for (auto i = 0ul; i < size; i++)
+                    data[i] = static_cast<char>(TWI::read(i + 1u == size));
+            }
+            else
+            {
+                _failed = true;
+                memset(data, 0xFF, size);
+            }
+            TWI::stop();
+
+            _stats.bytes_read += size;
+#if TRANSACTION_TRACE
+            transaction_trace.record(TraceOp::EEPROMRead, address, static_cast<uint16_t>(size), _chip_select);
+#endif
+        }
+
+    public:
+        const uint32_t size = Capacity;
+
+        explicit I2C_EEPROM(uint8_t chip_select = 0u)
+            : _chip_select(chip_select),
+            _stats(),
+            // The MCU may have been reset part way through a write cycle
+            _write_pending(true),
+            _write_started(millis()),
+            _failed(false)
+#if PAGE_WRITE_COUNTERS
+            , _page_writes()
+#endif
+        {
+        }
+
+        ~I2C_EEPROM() {}
+
+        // True while the chip is still committing the last page write
+        bool busy() const
+        {
+            if (!_write_pending)
+                return false;
+
+            if (acknowledges() || (millis() - _write_started) >= write_cycle_ms)
+                _write_pending = false;
+            return _write_pending;
+        }
+
+        void write(address_t address, const char* data, unsigned long size) override
+        {
+            for (auto i = 0ul; i < size;)
+            {
+                auto remaining = size - i;
+                auto page_bytes = bytes_to_page_end(address + i);
+                auto to_write = static_cast<uint16_t>((remaining < page_bytes) ? remaining : page_bytes);
+                write_page(address + i, data + i, to_write);
+                i += to_write;
+            }
+        }
+
+        CharString read(address_t address, unsigned long size) const override
+        {
+            auto result = CharString(size);
+            read(address, result.data(), size);
+            return result;
+        }
+
+        void read(address_t address, char* data, unsigned long size) const
+        {
+            for (auto i = 0ul; i < size;)
+            {
+                auto remaining = size - i;
+                auto block_bytes = bytes_to_block_end(address + i);
+                auto to_read = (remaining < block_bytes) ? remaining : block_bytes;
+                read_block(address + i, data + i, to_read);
+                i += to_read;
+            }
+        }
+
+        uint16_t page_writes(address_t address) const
+        {
+#if PAGE_WRITE_COUNTERS
+            return _page_writes[address / PageSize];
+#else
+            (void) address;
+            return 0u;
+#endif
+        }
+
+        // Whether a transaction was given up after max_attempts since the last call
+        bool take_failure()
+        {
+            auto failed = _failed;
+            _failed = false;
+            return failed;
+        }
+
+        const DeviceStats& stats() const
+        {
+            return _stats;
+        }
+
+        void reset_stats()
+        {
+            _stats = DeviceStats();
+        }
+};
+
+typedef I2C_EEPROM<2048ul, 16u, 1u, BlockSelect::LowBits> EEPROM_24LC16B;
+typedef I2C_EEPROM<4096ul, 32u, 2u, BlockSelect::None> EEPROM_24LC32;
+typedef I2C_EEPROM<8192ul, 32u, 2u, BlockSelect::None> EEPROM_24LC64;
+typedef I2C_EEPROM<16384ul, 64u, 2u, BlockSelect::None> EEPROM_24LC128;
+typedef I2C_EEPROM<32768ul, 64u, 2u, BlockSelect::None> EEPROM_24LC256;
+typedef I2C_EEPROM<65536ul, 128u, 2u, BlockSelect::None> EEPROM_24LC512;
+typedef I2C_EEPROM<131072ul, 128u, 2u, BlockSelect::HighBit> EEPROM_24LC1025;
+
+// Every profile must split writes at its page ends and address the right chip
+template <typename TChip>
+constexpr bool pages_end_where_expected()
+{
+    return TChip::bytes_to_page_end(0u) == TChip::page_size
+        && TChip::bytes_to_page_end(TChip::page_size - 1u) == 1u
+        && TChip::bytes_to_page_end(TChip::page_size) == TChip::page_size
+        && TChip::bytes_to_page_end(TChip::page_size + 3u) == TChip::page_size - 3u
+        && TChip::bytes_to_page_end(TChip::capacity - 1u) == 1u;
+}
+
+template <typename TChip>
+constexpr bool chip_select_picks_the_chip()
+{
+    for (auto chip = 0u; chip < TChip::max_chips; chip++)
+    {
+        if (TChip::device_address(chip, 0u) != 0x50u + chip
+            || TChip::device_address(chip, TChip::capacity - 1u) != 0x50u + chip)
+            return false;
+    }
+    return true;
+}
+
+static_assert(pages_end_where_expected<EEPROM_24LC16B>(), "24LC16B pages");
+static_assert(pages_end_where_expected<EEPROM_24LC32>(), "24LC32 pages");
+static_assert(pages_end_where_expected<EEPROM_24LC64>(), "24LC64 pages");
+static_assert(pages_end_where_expected<EEPROM_24LC128>(), "24LC128 pages");
+static_assert(pages_end_where_expected<EEPROM_24LC256>(), "24LC256 pages");
+static_assert(pages_end_where_expected<EEPROM_24LC512>(), "24LC512 pages");
+static_assert(pages_end_where_expected<EEPROM_24LC1025>(), "24LC1025 pages");
+
+static_assert(chip_select_picks_the_chip<EEPROM_24LC32>(), "24LC32 chip select");
+static_assert(chip_select_picks_the_chip<EEPROM_24LC64>(), "24LC64 chip select");
+static_assert(chip_select_picks_the_chip<EEPROM_24LC128>(), "24LC128 chip select");
+static_assert(chip_select_picks_the_chip<EEPROM_24LC256>(), "24LC256 chip select");
+static_assert(chip_select_picks_the_chip<EEPROM_24LC512>(), "24LC512 chip select");
+
+// The 24LC16B has a single chip per bus and takes address bits 10-8 in place of A2-A0
+static_assert(EEPROM_24LC16B::max_chips == 1u, "24LC16B is alone on its bus");
+static_assert(EEPROM_24LC16B::device_address(0u, 0x0FFu) == 0x50u, "24LC16B block 0");
+static_assert(EEPROM_24LC16B::device_address(0u, 0x100u) == 0x51u, "24LC16B block 1");
+static_assert(EEPROM_24LC16B::device_address(5u, 0x7FFu) == 0x57u, "24LC16B ignores chip select");
+static_assert(EEPROM_24LC16B::bytes_to_block_end(0x0FFu) == 1u, "24LC16B reads stop at each block");
+
+// The 24LC1025 takes the 64 KB block in B0, above the A1-A0 chip select
+static_assert(EEPROM_24LC1025::max_chips == 4u, "24LC1025 has two chip select pins");
+static_assert(EEPROM_24LC1025::device_address(1u, 0x0FFFFul) == 0x51u, "24LC1025 lower block");
+static_assert(EEPROM_24LC1025::device_address(1u, 0x10000ul) == 0x55u, "24LC1025 upper block");
+static_assert(EEPROM_24LC1025::device_address(3u, 0x1FFFFul) == 0x57u, "24LC1025 last byte");
+static_assert(EEPROM_24LC1025::bytes_to_block_end(0x0FFFFul) == 1u, "24LC1025 reads stop at 64 KB");
+static_assert(EEPROM_24LC1025::bytes_to_block_end(0x10000ul) == 0x10000ul, "24LC1025 upper block is whole");
+static_assert(EEPROM_24LC1025::bytes_to_page_end(0x0FFFFul) == 1u, "24LC1025 pages never cross blocks");
@@ -0,0 +1,33 @@
+#include "idle_scheduler.h"
+
+IdleScheduler::TaskId IdleScheduler::add(Task task, void* owner)
+{
+    _tasks.push_back(Entry { task, owner, false });
+    return static_cast<TaskId>(_tasks.size() - 1u);
+}
+
+void IdleScheduler::wake(TaskId id)
+{
+    _tasks[id].pending = true;
+}
+
+bool IdleScheduler::pending(TaskId id) const
+{
+    return _tasks[id].pending;
+}
+
+bool IdleScheduler::run_once()
+{
+    for (auto i = 0u; i < _tasks.size(); i++)
+    {
+        auto& entry = _tasks[_next];
+        _next = static_cast<uint8_t>((_next + 1u) % _tasks.size());
+
+        if (!entry.pending)
+            continue;
+
+        entry.pending = entry.task(entry.owner);
+        return true;
+    }
+    return false;
+}
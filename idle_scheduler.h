@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "static_vector.h"
+
+// Round robin runner for maintenance that can wait until the host is quiet.
+// Tasks do one bounded unit of work per call, so a command that arrives while
+// they run waits for at most one unit.
+class IdleScheduler
+{
+    public:
+        // Returns true while the task has more work to do
+        typedef bool (*Task)(void* owner);
+        typedef uint8_t TaskId;
+
+        static constexpr uint8_t max_tasks = 4u;
+
+    private:
+        struct Entry
+        {
+            Task task;
+            void* owner;
+            bool pending;
+        };
+
+        static_vector<Entry, max_tasks> _tasks;
+        uint8_t _next;
+
+    public:
+        IdleScheduler()
+            : _tasks(),
+            _next(0u)
+        {}
+
+        TaskId add(Task task, void* owner);
+        // Marks the task as having work; it runs on later calls to run_once()
+        void wake(TaskId id);
+        bool pending(TaskId id) const;
+        // Runs one unit of the next pending task and reports whether anything ran
+        bool run_once();
+};
+
+template <typename TOwner, bool (TOwner::*Fn)()>
+bool invoke_task(void* owner)
+{
+    return (static_cast<TOwner*>(owner)->*Fn)();
+}
@@ -1,30 +1,59 @@
 #include <Arduino.h>
 
 #include "inode.h"
+#include "packed_layout.h"
 #include "stream.h"
 
+static constexpr bool inode_header_layout_is_portable()
+{
+    auto buffer = InodeHeaderLayout::Buffer();
+    InodeHeaderLayout::store<0>(buffer, inode_t(0x1234u));
+    InodeHeaderLayout::store<1>(buffer, Flags::unpack(0xA5u).pack());
+    return buffer.bytes[0] == 0x34u && buffer.bytes[1] == 0x12u && buffer.bytes[2] == 0xA5u
+        && InodeHeaderLayout::load<0>(buffer) == 0x1234u
+        && Flags::unpack(InodeHeaderLayout::load<1>(buffer)).pack() == 0xA5u;
+}
+
+static_assert(InodeHeaderLayout::size == 3u, "Inode headers take three bytes on every target");
+static_assert(inode_header_layout_is_portable(), "Inode headers must encode little endian");
+static_assert(Flags(1u, 1u).pack() == (0x3u | (inode_format_version << 2u)), "Flags keep their bit positions");
+
+ostream& encode_inode_header(ostream& stream, inode_t next, const Flags& flags)
+{
+    auto buffer = InodeHeaderLayout::Buffer();
+    InodeHeaderLayout::store<0>(buffer, next);
+    InodeHeaderLayout::store<1>(buffer, flags.pack());
+    return stream.write(buffer.data(), InodeHeaderLayout::size);
+}
+
+istream& decode_inode_header(istream& stream, inode_t& next, Flags& flags)
+{
+    auto buffer = InodeHeaderLayout::Buffer();
+    stream.read(buffer.data(), InodeHeaderLayout::size);
+    next = InodeHeaderLayout::load<0>(buffer);
+    flags = Flags::unpack(InodeHeaderLayout::load<1>(buffer));
+    return stream;
+}
+
 ostream& operator<<(ostream& stream, const INode<void>& inode)
 {
-    return stream << inode.next << inode.flags;
+    return encode_inode_header(stream, inode.next, inode.flags);
 }
 
 istream& operator>>(istream& stream, INode<void>& inode)
 {
-    return stream >> inode.next >> inode.flags;
+    return decode_inode_header(stream, inode.next, inode.flags);
 }
 
 ostream& operator<<(ostream& stream, const Flags& flags)
 {
-    uint8_t data = 0u;
-    memcpy(&data, &flags, sizeof(data));
-    stream << data;
-    return stream;
+    return stream << flags.pack();
 }
 
 istream& operator>>(istream& stream, Flags& flags)
 {
-    uint8_t data = 0u;
-    stream >> data;
-    memcpy(&flags, &data, sizeof(data));
+    auto bits = uint8_t(0u);
+    stream >> bits;
+    flags = Flags::unpack(bits);
     return stream;
 }
@@ -2,40 +2,83 @@
 
 #include <utility.h>
 
+#include "packed_layout.h"
 #include "stream.h"
 #include "size.h"
 
 #define INODE_SIZE 64
 
+// Inode numbers rather than byte addresses, so 16 bits reach 4 MB of storage.
+// Inode 0 holds the master block, which lets 0 also mark the end of a chain.
+typedef uint16_t inode_t;
+
+// Version 0 stored byte addresses in INode::next; version 1 stores inode numbers
+static constexpr uint8_t inode_format_version = 1u;
+
 struct Flags
 {
     uint8_t in_use: 1;
     uint8_t is_file_header: 1;
-    uint8_t reserved: 6;
-
-    Flags(uint8_t used, uint8_t file)
+    uint8_t version: 3;
+    // Set on the destination of an inode move until the move completes; on the
+    // master inode it marks a move in progress, with the source held in INode::next
+    uint8_t relocating: 1;
+    // Set on the header of a removed file until its chain is freed; on the master
+    // inode it marks a chain being freed, with the header held in INode::next
+    uint8_t reclaiming: 1;
+    // Marks a shared string table entry; only meaningful on an inode that is neither a
+    // file header nor removed
+    uint8_t shared_string: 1;
+
+    constexpr Flags(uint8_t used, uint8_t file)
         :
         in_use(used),
         is_file_header(file),
-        reserved(0u) {}
+        version(used ? inode_format_version : 0u),
+        relocating(0u),
+        reclaiming(0u),
+        shared_string(0u) {}
 
-    Flags() : Flags(0u, 0u) {}
+    constexpr Flags() : Flags(0u, 0u) {}
+
+    // Bit 0 upwards in declaration order, which is how GCC lays out the bitfields on the
+    // AVR and so how every existing device was written
+    constexpr uint8_t pack() const
+    {
+        return static_cast<uint8_t>(in_use | (is_file_header << 1u) | (version << 2u)
+            | (relocating << 5u) | (reclaiming << 6u) | (shared_string << 7u));
+    }
+
+    static constexpr Flags unpack(uint8_t bits)
+    {
+        auto flags = Flags();
+        flags.in_use = bits & 0x1u;
+        flags.is_file_header = (bits >> 1u) & 0x1u;
+        flags.version = (bits >> 2u) & 0x7u;
+        flags.relocating = (bits >> 5u) & 0x1u;
+        flags.reclaiming = (bits >> 6u) & 0x1u;
+        flags.shared_string = (bits >> 7u) & 0x1u;
+        return flags;
+    }
 };
 
+// INode::next, then the packed Flags
+using InodeHeaderLayout = packed::Layout<inode_t, uint8_t>;
+
 template <typename T>
 struct INode
 {
-    uint16_t next;
+    inode_t next;
     Flags flags;
     T data;
 
-    INode(uint16_t n, bool is_file_header, T&& d)
+    INode(inode_t n, bool is_file_header, T&& d)
         :
         next(n),
         flags(1u, is_file_header ? 1u : 0u),
         data(std::move(d)) {}
 
-    INode(uint16_t n, bool is_file_header, const T& d)
+    INode(inode_t n, bool is_file_header, const T& d)
         :
         next(n),
         flags(1u, is_file_header ? 1u : 0u),
@@ -46,37 +89,42 @@ struct INode
 
     uint16_t size() const
     {
-        return sizeof(next) + sizeof(flags) + ::size(data);
+        return InodeHeaderLayout::size + ::size(data);
     }
 };
 
 template <>
 struct INode<void>
 {
-    uint16_t next;
+    inode_t next;
     Flags flags;
 
     INode() : next(0u), flags() {}
 
     uint16_t size() const
     {
-        return sizeof(next) + sizeof(flags);
+        return InodeHeaderLayout::size;
     }
 };
 
-static constexpr uint16_t usable_inode_space = INODE_SIZE - sizeof(INode<void>);
+static constexpr uint16_t usable_inode_space = INODE_SIZE - InodeHeaderLayout::size;
+
+ostream& encode_inode_header(ostream& stream, inode_t next, const Flags& flags);
+istream& decode_inode_header(istream& stream, inode_t& next, Flags& flags);
 
 template <typename T>
 ostream& operator<<(ostream& stream, const INode<T>& inode)
 {
-    stream << inode.next << inode.flags << inode.data;
+    encode_inode_header(stream, inode.next, inode.flags);
+    stream << inode.data;
     return stream;
 }
 
 template <typename T>
 istream& operator>>(istream& stream, INode<T>& inode)
 {
-    stream >> inode.next >> inode.flags >> inode.data;
+    decode_inode_header(stream, inode.next, inode.flags);
+    stream >> inode.data;
     return stream;
 }
 
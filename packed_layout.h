@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+#include <type_traits.h>
+
+// Fixed layouts for the headers kept on the device. Each layout lists its fields in
+// order; offsets follow from the field types alone and every field is stored little
+// endian, so a layout encodes to the same bytes on the AVR and on a host whatever their
+// padding, byte order or sizeof(int). Whole headers go through one buffer, and so one
+// device transaction, instead of a stream call per field.
+namespace packed
+{
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    constexpr void store(uint8_t* out, T value)
+    {
+        static_assert(sizeof(T) <= sizeof(uint32_t), "Fields are at most 32 bits");
+        for (auto i = 0u; i < sizeof(T); i++)
+            out[i] = static_cast<uint8_t>(static_cast<uint32_t>(value) >> (8u * i));
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    constexpr T load(const uint8_t* in)
+    {
+        static_assert(sizeof(T) <= sizeof(uint32_t), "Fields are at most 32 bits");
+        auto value = uint32_t(0u);
+        for (auto i = 0u; i < sizeof(T); i++)
+            value |= static_cast<uint32_t>(in[i]) << (8u * i);
+        return static_cast<T>(value);
+    }
+
+    namespace detail
+    {
+        template <uint8_t Index, typename ... TFields>
+        struct field_at;
+
+        template <typename TFirst, typename ... TRest>
+        struct field_at<0u, TFirst, TRest...>
+        {
+            typedef TFirst type;
+            static constexpr uint8_t offset = 0u;
+        };
+
+        template <uint8_t Index, typename TFirst, typename ... TRest>
+        struct field_at<Index, TFirst, TRest...>
+        {
+            typedef typename field_at<Index - 1u, TRest...>::type type;
+            static constexpr uint8_t offset = sizeof(TFirst) + field_at<Index - 1u, TRest...>::offset;
+        };
+    }
+
+    template <typename ... TFields>
+    struct Layout
+    {
+        static constexpr uint8_t size = static_cast<uint8_t>((0u + ... + sizeof(TFields)));
+
+        template <uint8_t Index>
+        using type = typename detail::field_at<Index, TFields...>::type;
+
+        template <uint8_t Index>
+        static constexpr uint8_t offset = detail::field_at<Index, TFields...>::offset;
+
+        // Encoded bytes of one header, small enough to live on the stack
+        struct Buffer
+        {
+            uint8_t bytes[size];
+
+            constexpr Buffer() : bytes() {}
+
+            char* data()
+            {
+                return reinterpret_cast<char*>(bytes);
+            }
+
+            const char* data() const
+            {
+                return reinterpret_cast<const char*>(bytes);
+            }
+        };
+
+        template <uint8_t Index>
+        static constexpr void store(Buffer& buffer, type<Index> value)
+        {
+            packed::store(buffer.bytes + offset<Index>, value);
+        }
+
+        template <uint8_t Index>
+        static constexpr type<Index> load(const Buffer& buffer)
+        {
+            return packed::load<type<Index>>(buffer.bytes + offset<Index>);
+        }
+    };
+}
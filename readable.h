@@ -1,5 +1,7 @@
 #pragma once
 
+#include "address.h"
+
 class CharString;
 
 class IReadable
@@ -7,5 +9,5 @@ class IReadable
     public:
         virtual ~IReadable() {};
 
-        virtual CharString read(unsigned short address, unsigned long size) const = 0;
+        virtual CharString read(address_t address, unsigned long size) const = 0;
 };
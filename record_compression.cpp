@@ -0,0 +1,234 @@
+#include "record_compression.h"
+
+#include <Arduino.h>
+
+#include "char_string.h"
+
+static constexpr uint8_t max_literal_run = 0x80u;
+static constexpr uint8_t dictionary_token = 0x80u;
+static constexpr uint8_t copy_token = 0xC0u;
+static constexpr uint8_t min_copy_length = 3u;
+static constexpr uint8_t max_copy_length = 0x3Fu + min_copy_length;
+static constexpr uint16_t max_copy_distance = 0x100u;
+
+// Fragments common in the names and usernames of stored credentials
+static const char dictionary_text[] PROGMEM =
+    "@gmail.com" "@googlemail.com" "@outlook.com" "@hotmail.com" "@yahoo.com" "@icloud.com"
+    "@live.com" "@protonmail.com" "@proton.me" "@aol.com" "@mail.com" "@gmx.com"
+    "https://" "http://" "www." ".com" ".org" ".net" ".co.uk" ".io"
+    "admin" "user" "login" "account" "mail" "google" "github" "amazon" "facebook"
+    "twitter" "microsoft" "apple" "bank" "steam" "netflix" "paypal" "linkedin" "reddit"
+    "password" "work" "home" "test" "root" "name" "shop" "online"
+    "the" "ing" "ion" "and" "er" "on" "an" "in" "re" "es" "st" "or" "te" "al" "at" "en"
+    "ar" "it";
+
+static const uint8_t dictionary_lengths[] PROGMEM = {
+    10u, 15u, 12u, 12u, 10u, 11u,
+    9u, 15u, 10u, 8u, 9u, 8u,
+    8u, 7u, 4u, 4u, 4u, 4u, 6u, 3u,
+    5u, 4u, 5u, 7u, 4u, 6u, 6u, 6u, 8u,
+    7u, 9u, 5u, 4u, 5u, 7u, 6u, 8u, 6u,
+    8u, 4u, 4u, 4u, 4u, 4u, 4u, 6u,
+    3u, 3u, 3u, 3u, 2u, 2u, 2u, 2u, 2u, 2u, 2u, 2u, 2u, 2u, 2u, 2u,
+    2u, 2u
+};
+
+static constexpr uint8_t dictionary_size = sizeof(dictionary_lengths);
+static_assert(dictionary_size <= 0x40u, "Dictionary tokens carry a six bit index");
+
+struct Match
+{
+    uint8_t token;
+    uint8_t length;
+    uint8_t distance;
+};
+
+static uint8_t dictionary_byte(uint16_t offset)
+{
+    uint8_t value = 0u;
+    memcpy_P(&value, dictionary_text + offset, sizeof(value));
+    return value;
+}
+
+static uint8_t dictionary_length(uint8_t entry)
+{
+    uint8_t length = 0u;
+    memcpy_P(&length, dictionary_lengths + entry, sizeof(length));
+    return length;
+}
+
+static uint16_t dictionary_offset(uint8_t entry)
+{
+    auto offset = 0u;
+    for (auto i = 0u; i < entry; i++)
+        offset += dictionary_length(static_cast<uint8_t>(i));
+    return static_cast<uint16_t>(offset);
+}
+
+// Picks whichever of a dictionary entry or an earlier run saves the most output bytes
+static Match find_match(const char* data, unsigned int position, unsigned int size)
+{
+    auto best = Match { 0u, 0u, 0u };
+    auto best_saving = 0;
+    auto remaining = size - position;
+
+    auto offset = 0u;
+    for (auto entry = 0u; entry < dictionary_size; entry++)
+    {
+        auto length = dictionary_length(static_cast<uint8_t>(entry));
+        auto saving = static_cast<int>(length) - 1;
+        if (length <= remaining && saving > best_saving)
+        {
+            auto matched = 0u;
+            while (matched < length && static_cast<uint8_t>(data[position + matched]) == dictionary_byte(static_cast<uint16_t>(offset + matched)))
+                matched++;
+
+            if (matched == length)
+            {
+                best = Match { static_cast<uint8_t>(dictionary_token | entry), static_cast<uint8_t>(length), 0u };
+                best_saving = saving;
+            }
+        }
+        offset += length;
+    }
+
+    auto window = (position < max_copy_distance) ? position : max_copy_distance;
+    for (auto distance = 1u; distance <= window; distance++)
+    {
+        auto length = 0u;
+        while (length < max_copy_length && length < remaining
+            && data[position + length] == data[position + length - distance])
+            length++;
+
+        auto saving = static_cast<int>(length) - 2;
+        if (length >= min_copy_length && saving > best_saving)
+        {
+            best = Match {
+                static_cast<uint8_t>(copy_token | (length - min_copy_length)),
+                static_cast<uint8_t>(length),
+                static_cast<uint8_t>(distance - 1u)
+            };
+            best_saving = saving;
+        }
+    }
+
+    return best;
+}
+
+CharString compress_record(const CharString& record)
+{
+    auto size = record.length();
+    const auto* data = record.data();
+
+    // Worst case every byte is a literal, one token per max_literal_run of them
+    auto out = CharString(static_cast<unsigned int>(size + size / max_literal_run + 1u));
+    auto* output = out.data();
+    auto written = 0u;
+
+    auto literal_start = 0u;
+    auto literal_length = 0u;
+    for (auto position = 0u; position < size;)
+    {
+        auto match = find_match(data, position, size);
+        if (match.length == 0u)
+        {
+            if (literal_length == 0u)
+                literal_start = written++;
+            output[written++] = data[position++];
+            if (++literal_length == max_literal_run)
+            {
+                output[literal_start] = static_cast<char>(literal_length - 1u);
+                literal_length = 0u;
+            }
+            continue;
+        }
+
+        if (literal_length > 0u)
+        {
+            output[literal_start] = static_cast<char>(literal_length - 1u);
+            literal_length = 0u;
+        }
+
+        output[written++] = static_cast<char>(match.token);
+        if ((match.token & copy_token) == copy_token)
+            output[written++] = static_cast<char>(match.distance);
+        position += match.length;
+    }
+
+    if (literal_length > 0u)
+        output[literal_start] = static_cast<char>(literal_length - 1u);
+
+    return out.read(0u, written);
+}
+
+// Walks the tokens without expanding them, so the output can be allocated once
+static bool expanded_size(const char* input, unsigned int input_size, unsigned int& size)
+{
+    size = 0u;
+    for (auto read = 0u; read < input_size;)
+    {
+        auto token = static_cast<uint8_t>(input[read++]);
+        if ((token & dictionary_token) == 0u)
+        {
+            size += token + 1u;
+            read += token + 1u;
+        }
+        else if ((token & copy_token) == dictionary_token)
+        {
+            if ((token & 0x3Fu) >= dictionary_size)
+                return false;
+            size += dictionary_length(static_cast<uint8_t>(token & 0x3Fu));
+        }
+        else
+        {
+            if (read >= input_size || static_cast<uint8_t>(input[read++]) + 1u > size)
+                return false;
+            size += (token & 0x3Fu) + min_copy_length;
+        }
+
+        if (read > input_size)
+            return false;
+    }
+    return true;
+}
+
+CharString expand_record(const CharString& compressed)
+{
+    const auto* input = compressed.data();
+    auto input_size = compressed.length();
+
+    auto size = 0u;
+    if (!expanded_size(input, input_size, size))
+        return CharString();
+
+    auto out = CharString(size);
+    auto* output = out.data();
+
+    auto position = 0u;
+    for (auto read = 0u; read < input_size;)
+    {
+        auto token = static_cast<uint8_t>(input[read++]);
+        if ((token & dictionary_token) == 0u)
+        {
+            memcpy(output + position, input + read, token + 1u);
+            position += token + 1u;
+            read += token + 1u;
+        }
+        else if ((token & copy_token) == dictionary_token)
+        {
+            auto entry = static_cast<uint8_t>(token & 0x3Fu);
+            auto length = dictionary_length(entry);
+            memcpy_P(output + position, dictionary_text + dictionary_offset(entry), length);
+            position += length;
+        }
+        else
+        {
+            // Byte by byte, as a copy may overlap the bytes it produces
+            auto distance = static_cast<uint8_t>(input[read++]) + 1u;
+            for (auto length = (token & 0x3Fu) + min_copy_length; length > 0u; length--, position++)
+                output[position] = output[position - distance];
+        }
+    }
+
+    return out;
+}
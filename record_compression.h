@@ -0,0 +1,18 @@
+#pragma once
+
+#include "char_string.h"
+
+// Override with -DRECORD_COMPRESSION=0 to store the fields of new records uncompressed;
+// compressed fields already on the device can always be read
+#ifndef RECORD_COMPRESSION
+#define RECORD_COMPRESSION 1
+#endif
+
+// LZ style coding tuned for short, repetitive records such as e-mail addresses and
+// site names. The output is a sequence of tokens:
+//   0lllllll            l + 1 literal bytes follow
+//   10dddddd            entry d of the built in dictionary
+//   11llllll oooooooo   copy l + 3 bytes from o + 1 bytes back
+CharString compress_record(const CharString& record);
+// Returns an empty string if the input is not a complete token sequence
+CharString expand_record(const CharString& compressed);
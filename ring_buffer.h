@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Arduino.h>
+
+template <typename T, uint16_t N>
+class RingBuffer
+{
+    private:
+        T _data[N];
+        uint16_t _head;
+        uint16_t _count;
+
+    public:
+        RingBuffer()
+            : _data(),
+            _head(0u),
+            _count(0u)
+        {}
+
+        static constexpr uint16_t capacity()
+        {
+            return N;
+        }
+
+        uint16_t size() const
+        {
+            return _count;
+        }
+
+        bool empty() const
+        {
+            return _count == 0u;
+        }
+
+        bool full() const
+        {
+            return _count == N;
+        }
+
+        bool push(T value)
+        {
+            if (full())
+                return false;
+            _data[(_head + _count) % N] = value;
+            _count++;
+            return true;
+        }
+
+        // Makes room by dropping the oldest value when full; returns whether one was dropped
+        bool push_overwriting(T value)
+        {
+            auto dropped = full();
+            if (dropped)
+                pop();
+            push(value);
+            return dropped;
+        }
+
+        T pop()
+        {
+            auto value = _data[_head];
+            _head = (_head + 1u) % N;
+            _count--;
+            return value;
+        }
+
+        void clear()
+        {
+            _head = 0u;
+            _count = 0u;
+        }
+};
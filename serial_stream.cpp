@@ -3,17 +3,150 @@
 #include <Arduino.h>
 
 #include "char_string.h"
+#include "transaction_trace.h"
 
-void SerialStream::write(unsigned short, const char* data, unsigned long size)
+#include <string.h>
+
+void SerialStream::write(address_t, const char* data, unsigned long size)
 {
     Serial.write(data, size);
-    Serial.flush();
+    _stats.bytes_written += size;
+#if TRANSACTION_TRACE
+    transaction_trace.record(TraceOp::SerialWrite, 0u, static_cast<uint16_t>(size));
+#endif
 }
 
-CharString SerialStream::read(unsigned short, unsigned long size) const
+CharString SerialStream::read(address_t address, unsigned long size) const
 {
-    while (!Serial.available()) {}
     auto output = CharString(size);
-    Serial.readBytes(output.data(), size);
+    auto* out = output.data();
+
+    for (auto i = 0ul; i < size; i++)
+    {
+        if (address + i >= _read_limit)
+        {
+            memset(out + i, 0, size - i);
+            size = i;
+            _overran = true;
+            break;
+        }
+
+        if (_received.empty())
+        {
+            auto wait_start = micros();
+            while (_received.empty())
+                receive();
+            _stats.wait_us += micros() - wait_start;
+        }
+
+        out[i] = _received.pop();
+        grant_credit();
+    }
+
+    _stats.bytes_read += size;
+#if TRANSACTION_TRACE
+    transaction_trace.record(TraceOp::SerialRead, 0u, static_cast<uint16_t>(size));
+#endif
     return output;
 }
+
+void SerialStream::receive() const
+{
+    while (!_received.full() && Serial.available())
+        _received.push(static_cast<char>(Serial.read()));
+}
+
+uint16_t SerialStream::available() const
+{
+    receive();
+    return _received.size();
+}
+
+void SerialStream::limit_reads(address_t end)
+{
+    _read_limit = end;
+    _overran = false;
+}
+
+bool SerialStream::overran() const
+{
+    return _overran;
+}
+
+void SerialStream::grant_credit() const
+{
+    if (!_flow_control || ++_consumed_since_grant < credit_size)
+        return;
+
+    _consumed_since_grant = 0u;
+    Serial.write(credit_grant);
+}
+
+void SerialStream::set_flow_control(bool enabled)
+{
+    _flow_control = enabled;
+    reset_credit();
+}
+
+void SerialStream::reset_credit()
+{
+    _consumed_since_grant = 0u;
+}
+
+bool SerialStream::supports_baud_rate(uint32_t baud_rate)
+{
+    if (baud_rate < minimum_baud_rate)
+        return false;
+
+#ifdef F_CPU
+    // The UART runs in double speed mode, dividing the clock by 8 * (UBRR + 1)
+    auto divisor = (F_CPU / 8ul + baud_rate / 2u) / baud_rate;
+    if (divisor == 0u || divisor > 4096u)
+        return false;
+
+    auto actual = F_CPU / 8ul / divisor;
+    auto error = (actual > baud_rate) ? actual - baud_rate : baud_rate - actual;
+    return error * 40u <= baud_rate;
+#else
+    return true;
+#endif
+}
+
+uint32_t SerialStream::baud_rate() const
+{
+    return _baud_rate;
+}
+
+void SerialStream::set_baud_rate(uint32_t baud_rate)
+{
+    Serial.flush();
+    Serial.end();
+    Serial.begin(baud_rate);
+    _baud_rate = baud_rate;
+
+    _received.clear();
+    reset_credit();
+}
+
+bool SerialStream::expect(char expected, unsigned long timeout_ms)
+{
+    auto started = millis();
+    while (_received.empty() && (millis() - started) < timeout_ms)
+        receive();
+
+    if (_received.empty())
+        return false;
+
+    _stats.bytes_read++;
+    return _received.pop() == expected;
+}
+
+const SerialStats& SerialStream::stats() const
+{
+    return _stats;
+}
+
+void SerialStream::reset_stats()
+{
+    _stats = SerialStats();
+}
@@ -2,11 +2,81 @@
 
 #include "char_string.h"
 #include "readable.h"
+#include "ring_buffer.h"
+#include "stats.h"
 #include "writeable.h"
 
+// Override with -DBLUEFISH_RX_BUFFER_SIZE=n; sized to leave the UNO most of its RAM. Kept
+// apart from the core's SERIAL_RX_BUFFER_SIZE, which sizes HardwareSerial's own buffer.
+#ifndef BLUEFISH_RX_BUFFER_SIZE
+#if defined(__AVR_ATmega1284P__) || defined(__AVR_ATmega1284__)
+#define BLUEFISH_RX_BUFFER_SIZE 1024
+#else
+#define BLUEFISH_RX_BUFFER_SIZE 128
+#endif
+#endif
+
 class SerialStream : public IReadable, public IWriteable
 {
     public:
-        void write(unsigned short address, const char* data, unsigned long size) override;
-        CharString read(unsigned short address, unsigned long size) const override;
+        static constexpr uint16_t receive_buffer_size = BLUEFISH_RX_BUFFER_SIZE;
+        static constexpr uint16_t credit_size = receive_buffer_size / 2u;
+        static constexpr char credit_grant = 0x05;
+
+        static constexpr address_t no_read_limit = ~address_t(0u);
+
+        static constexpr uint32_t default_baud_rate = 115200ul;
+        static constexpr uint32_t minimum_baud_rate = 9600ul;
+
+    private:
+        mutable RingBuffer<char, receive_buffer_size> _received;
+        mutable SerialStats _stats;
+        mutable uint16_t _consumed_since_grant;
+        address_t _read_limit;
+        mutable bool _overran;
+        bool _flow_control;
+        uint32_t _baud_rate;
+
+        void grant_credit() const;
+
+    public:
+        SerialStream()
+            : _received(),
+            _stats(),
+            _consumed_since_grant(0u),
+            _read_limit(no_read_limit),
+            _overran(false),
+            _flow_control(false),
+            _baud_rate(default_baud_rate)
+        {}
+
+        void write(address_t address, const char* data, unsigned long size) override;
+        CharString read(address_t address, unsigned long size) const override;
+
+        // Moves whatever the UART has received into the stream's own buffer without blocking
+        void receive() const;
+        uint16_t available() const;
+
+        // Reads at or past stream position end come back as zeros without consuming anything,
+        // so a handler cannot run into the next pipelined request. Setting a limit clears
+        // overran(), which reports whether any read has hit it since.
+        void limit_reads(address_t end);
+        bool overran() const;
+
+        // With flow control on, a host that has just seen Ready may send receive_buffer_size
+        // bytes, and credit_size more for each credit_grant byte the device sends back while
+        // it consumes the request. Grants are never sent once a response has started.
+        void set_flow_control(bool enabled);
+        void reset_credit();
+
+        // Whether the UART can run at baud_rate within 2.5% of the requested rate
+        static bool supports_baud_rate(uint32_t baud_rate);
+        uint32_t baud_rate() const;
+        // Drains pending output, then restarts the UART at baud_rate and drops any buffered input
+        void set_baud_rate(uint32_t baud_rate);
+        // Consumes the next byte if it arrives within timeout_ms and reports whether it was expected
+        bool expect(char expected, unsigned long timeout_ms);
+
+        const SerialStats& stats() const;
+        void reset_stats();
 };
@@ -0,0 +1,20 @@
+#include "shared_string.h"
+#include "stream.h"
+#include "size.h"
+
+ostream& operator<<(ostream& stream, const SharedString& entry)
+{
+    stream << entry.references << entry.value;
+    return stream;
+}
+
+istream& operator>>(istream& stream, SharedString& entry)
+{
+    stream >> entry.references >> entry.value;
+    return stream;
+}
+
+uint16_t SharedString::size() const
+{
+    return ::size(references) + ::size(value);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "char_string.h"
+#include "inode.h"
+#include "stream.h"
+#include <utility.h>
+
+// Override with -DSHARED_USERNAMES=0 to store usernames inside each record;
+// records that refer to the string table can always be read
+#ifndef SHARED_USERNAMES
+#define SHARED_USERNAMES 1
+#endif
+
+// An entry of the on-device string table, counting the records that refer to it
+struct SharedString
+{
+    uint16_t references;
+    CharString value;
+
+    SharedString(uint16_t count, CharString&& v)
+        :
+        references(count),
+        value(std::move(v))
+    {}
+
+    SharedString()
+        : SharedString(0u, {})
+    {}
+    SharedString(const SharedString&) = delete;
+    SharedString(SharedString&&) = default;
+    SharedString& operator=(const SharedString&) = delete;
+    SharedString& operator=(SharedString&&) = default;
+
+    uint16_t size() const;
+};
+
+ostream& operator<<(ostream& stream, const SharedString& entry);
+istream& operator>>(istream& stream, SharedString& entry);
+
+// Each entry takes a single inode outside any chain
+using SharedStringINode = INode<SharedString>;
+
+static constexpr unsigned int max_shared_string_length =
+    usable_inode_space - sizeof(uint16_t) - sizeof(CharString::length_prefix_t);
+
+inline bool is_shared_string(const Flags& flags)
+{
+    return flags.in_use && !flags.is_file_header && !flags.reclaiming && flags.shared_string;
+}
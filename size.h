@@ -14,9 +14,12 @@ namespace detail {
     struct supports_size<T, void_t<decltype(std::declval<T>().size())>>
         : std::true_type {};
 
+    template <typename T>
+    using remove_cvref_t = std::remove_cv_t<std::remove_reference_t<T>>;
+
     template <typename T>
     static constexpr bool supports_size_v =
-        supports_size<std::remove_cvref_t<T>>::value;
+        supports_size<remove_cvref_t<T>>::value;
 }
 
 template <typename T, typename = std::enable_if_t<detail::supports_size_v<T>>>
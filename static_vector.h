@@ -0,0 +1,165 @@
+#pragma once
+
+#include <type_traits.h>
+#include <utility.h>
+
+template <typename T, unsigned int N>
+class static_vector
+{
+    public:
+        typedef T value_type;
+        typedef unsigned int size_type;
+        typedef std::add_lvalue_reference_t<T> reference;
+        typedef std::add_lvalue_reference_t<std::add_const_t<T>> const_reference;
+        typedef T* iterator;
+        typedef std::add_const_t<T>* const_iterator;
+
+    private:
+        T _data[N];
+        size_type _size;
+
+    public:
+        static_vector()
+            : _data(),
+              _size(0u)
+        {}
+
+        static_vector(const static_vector&) = default;
+        static_vector(static_vector&&) = default;
+        static_vector& operator=(const static_vector&) = default;
+        static_vector& operator=(static_vector&&) = default;
+
+        reference operator[](size_type position)
+        {
+            return _data[position];
+        }
+
+        const_reference operator[](size_type position) const
+        {
+            return _data[position];
+        }
+
+        reference front()
+        {
+            return _data[0];
+        }
+
+        const_reference front() const
+        {
+            return _data[0];
+        }
+
+        reference back()
+        {
+            return _data[_size - 1u];
+        }
+
+        const_reference back() const
+        {
+            return _data[_size - 1u];
+        }
+
+        T* data()
+        {
+            return _data;
+        }
+
+        const T* data() const
+        {
+            return _data;
+        }
+
+        iterator begin()
+        {
+            return _data;
+        }
+
+        const_iterator begin() const
+        {
+            return _data;
+        }
+
+        const_iterator cbegin() const
+        {
+            return _data;
+        }
+
+        iterator end()
+        {
+            return _data + _size;
+        }
+
+        const_iterator end() const
+        {
+            return _data + _size;
+        }
+
+        const_iterator cend() const
+        {
+            return _data + _size;
+        }
+
+        bool empty() const
+        {
+            return _size == 0u;
+        }
+
+        bool full() const
+        {
+            return _size == N;
+        }
+
+        size_type size() const
+        {
+            return _size;
+        }
+
+        static constexpr size_type capacity()
+        {
+            return N;
+        }
+
+        void clear()
+        {
+            for (auto i = 0u; i < _size; i++)
+                _data[i] = T();
+            _size = 0u;
+        }
+
+        // Returns false and leaves the container untouched once it is full
+        bool push_back(T&& value)
+        {
+            if (full())
+                return false;
+            _data[_size++] = std::move(value);
+            return true;
+        }
+
+        template <typename U = T, typename = std::enable_if_t<std::is_copy_constructible_v<U>>>
+        bool push_back(const T& value)
+        {
+            if (full())
+                return false;
+            _data[_size++] = value;
+            return true;
+        }
+
+        template <typename ... TArgs>
+        bool emplace_back(TArgs&&... args)
+        {
+            return push_back(T(std::forward<TArgs>(args)...));
+        }
+
+        void pop_back()
+        {
+            _data[--_size] = T();
+        }
+
+        iterator erase(iterator position)
+        {
+            for (auto it = position; it + 1 != end(); it++)
+                *it = std::move(*(it + 1));
+            _data[--_size] = T();
+            return position;
+        }
+};
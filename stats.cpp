@@ -0,0 +1,32 @@
+#include "stats.h"
+
+#include "stream.h"
+
+void CommandStats::record(uint32_t elapsed_us)
+{
+    count++;
+    total_us += elapsed_us;
+    if (elapsed_us > max_us)
+        max_us = elapsed_us;
+}
+
+ostream& operator<<(ostream& stream, const DeviceStats& stats)
+{
+    return stream << stats.transactions << stats.bytes_read << stats.bytes_written
+        << stats.write_cycles << stats.delay_ms << stats.errors;
+}
+
+ostream& operator<<(ostream& stream, const SerialStats& stats)
+{
+    return stream << stats.bytes_read << stats.bytes_written << stats.wait_us;
+}
+
+ostream& operator<<(ostream& stream, const FileSystemStats& stats)
+{
+    return stream << stats.header_scans << stats.allocation_scans << stats.cache_hits << stats.cache_misses;
+}
+
+ostream& operator<<(ostream& stream, const CommandStats& stats)
+{
+    return stream << stats.count << stats.total_us << stats.max_us;
+}
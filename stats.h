@@ -0,0 +1,73 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "stream.h"
+
+struct DeviceStats
+{
+    uint32_t transactions;
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+    uint32_t write_cycles;
+    uint32_t delay_ms;
+    // Transactions the chip did not acknowledge, each of which was tried again
+    uint32_t errors;
+
+    DeviceStats()
+        : transactions(0u),
+        bytes_read(0u),
+        bytes_written(0u),
+        write_cycles(0u),
+        delay_ms(0u),
+        errors(0u)
+    {}
+};
+
+struct SerialStats
+{
+    uint32_t bytes_read;
+    uint32_t bytes_written;
+    uint32_t wait_us;
+
+    SerialStats()
+        : bytes_read(0u),
+        bytes_written(0u),
+        wait_us(0u)
+    {}
+};
+
+struct FileSystemStats
+{
+    uint32_t header_scans;
+    uint32_t allocation_scans;
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+
+    FileSystemStats()
+        : header_scans(0u),
+        allocation_scans(0u),
+        cache_hits(0u),
+        cache_misses(0u)
+    {}
+};
+
+struct CommandStats
+{
+    uint16_t count;
+    uint32_t total_us;
+    uint32_t max_us;
+
+    CommandStats()
+        : count(0u),
+        total_us(0u),
+        max_us(0u)
+    {}
+
+    void record(uint32_t elapsed_us);
+};
+
+ostream& operator<<(ostream& stream, const DeviceStats& stats);
+ostream& operator<<(ostream& stream, const SerialStats& stats);
+ostream& operator<<(ostream& stream, const FileSystemStats& stats);
+ostream& operator<<(ostream& stream, const CommandStats& stats);
@@ -8,6 +8,7 @@
 class ostream;
 class istream;
 
+#include "address.h"
 #include "readable.h"
 #include "writeable.h"
 
@@ -16,7 +17,7 @@ class ios_base
 {
     protected:
         T* _device;
-        size_t _position;
+        address_t _position;
 
 
     public:
@@ -0,0 +1,57 @@
+#include "transaction_trace.h"
+
+#include <Arduino.h>
+
+#include "stream.h"
+
+#if TRANSACTION_TRACE
+TransactionTrace transaction_trace;
+#endif
+
+ostream& operator<<(ostream& stream, const TraceEvent& event)
+{
+    return stream << event.time_us << event.address << event.length
+        << static_cast<uint8_t>(event.op) << event.chip;
+}
+
+void TransactionTrace::record(TraceOp op, uint32_t address, uint16_t length, uint8_t chip)
+{
+    if (_suspended)
+        return;
+
+    auto event = TraceEvent();
+    event.time_us = micros();
+    event.address = address;
+    event.length = length;
+    event.op = op;
+    event.chip = chip;
+
+    if (_events.push_overwriting(event))
+        _dropped++;
+}
+
+uint16_t TransactionTrace::size() const
+{
+    return _events.size();
+}
+
+TraceEvent TransactionTrace::pop()
+{
+    return _events.pop();
+}
+
+uint32_t TransactionTrace::dropped() const
+{
+    return _dropped;
+}
+
+void TransactionTrace::clear()
+{
+    _events.clear();
+    _dropped = 0u;
+}
+
+void TransactionTrace::suspend(bool suspended)
+{
+    _suspended = suspended;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "ring_buffer.h"
+#include "stream.h"
+
+// Override with -DTRANSACTION_TRACE=1 to record bus and command events for DumpTrace.
+// Override the number of events kept with -DTRACE_EVENTS=n; each takes 12 bytes of RAM.
+#ifndef TRANSACTION_TRACE
+#define TRANSACTION_TRACE 0
+#endif
+#ifndef TRACE_EVENTS
+#if defined(__AVR_ATmega1284P__) || defined(__AVR_ATmega1284__)
+#define TRACE_EVENTS 128
+#else
+#define TRACE_EVENTS 16
+#endif
+#endif
+
+enum class TraceOp : uint8_t
+{
+    // address is the word address within the chip
+    EEPROMRead = 0u,
+    EEPROMWrite,
+    // address is unused
+    SerialRead,
+    SerialWrite,
+    // address holds the Command byte
+    CommandStart,
+    CommandEnd
+};
+
+struct TraceEvent
+{
+    uint32_t time_us;
+    uint32_t address;
+    uint16_t length;
+    TraceOp op;
+    // Chip select for EEPROM events, otherwise 0
+    uint8_t chip;
+
+    TraceEvent()
+        : time_us(0u),
+        address(0u),
+        length(0u),
+        op(TraceOp::EEPROMRead),
+        chip(0u)
+    {}
+};
+
+// Serialized as time_us, address, length, op and chip, 12 bytes little endian
+ostream& operator<<(ostream& stream, const TraceEvent& event);
+
+// Keeps the most recent events, dropping the oldest once full
+class TransactionTrace
+{
+    private:
+        RingBuffer<TraceEvent, TRACE_EVENTS> _events;
+        uint32_t _dropped;
+        bool _suspended;
+
+    public:
+        TransactionTrace()
+            : _events(),
+            _dropped(0u),
+            _suspended(false)
+        {}
+
+        void record(TraceOp op, uint32_t address, uint16_t length, uint8_t chip = 0u);
+
+        uint16_t size() const;
+        TraceEvent pop();
+        // Events lost to overwriting since the last clear()
+        uint32_t dropped() const;
+        void clear();
+        // Stops recording, so dumping the trace over serial does not disturb it
+        void suspend(bool suspended);
+};
+
+#if TRANSACTION_TRACE
+extern TransactionTrace transaction_trace;
+#endif
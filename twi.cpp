@@ -0,0 +1,85 @@
+#include "twi.h"
+
+#include <Arduino.h>
+#include <avr/io.h>
+#include <util/twi.h>
+
+namespace
+{
+    // Far longer than one byte takes at 100 kHz, so only a wedged bus trips it
+    constexpr uint16_t max_wait_iterations = 20000u;
+
+    bool wait_for_bus()
+    {
+        for (auto i = 0u; i < max_wait_iterations; i++)
+        {
+            if (TWCR & _BV(TWINT))
+                return true;
+        }
+
+        // Release the bus and re-enable the peripheral so the next transaction can recover
+        TWCR = 0u;
+        TWCR = _BV(TWEN);
+        return false;
+    }
+
+    bool transmit(uint8_t control)
+    {
+        TWCR = control | _BV(TWINT) | _BV(TWEN);
+        return wait_for_bus();
+    }
+}
+
+void TWI::begin(uint32_t frequency)
+{
+    // Internal pull-ups, as Wire does; boards should still fit external ones for 1 MHz
+    digitalWrite(SDA, HIGH);
+    digitalWrite(SCL, HIGH);
+
+    auto divider = F_CPU / frequency;
+    TWSR = 0u;
+    TWBR = (divider > 16u) ? static_cast<uint8_t>((divider - 16u) / 2u) : 0u;
+    TWCR = _BV(TWEN);
+}
+
+bool TWI::start(uint8_t address, Direction direction)
+{
+    if (!transmit(_BV(TWSTA)))
+        return false;
+    if (TW_STATUS != TW_START && TW_STATUS != TW_REP_START)
+        return false;
+
+    TWDR = static_cast<uint8_t>((address << 1) | static_cast<uint8_t>(direction));
+    if (!transmit(0u))
+        return false;
+
+    return TW_STATUS == ((direction == Direction::Write) ? TW_MT_SLA_ACK : TW_MR_SLA_ACK);
+}
+
+bool TWI::write(uint8_t data)
+{
+    TWDR = data;
+    return transmit(0u) && TW_STATUS == TW_MT_DATA_ACK;
+}
+
+bool TWI::write(const char* data, uint32_t size)
+{
+    for (auto i = 0ul; i < size; i++)
+    {
+        if (!write(static_cast<uint8_t>(data[i])))
+            return false;
+    }
+    return true;
+}
+
+uint8_t TWI::read(bool last)
+{
+    transmit(last ? 0u : _BV(TWEA));
+    return TWDR;
+}
+
+void TWI::stop()
+{
+    TWCR = _BV(TWINT) | _BV(TWEN) | _BV(TWSTO);
+    for (auto i = 0u; i < max_wait_iterations && (TWCR & _BV(TWSTO)); i++) {}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <Arduino.h>
+
+// 400 kHz suits the 24LC512; 24FC512 parts can be built with -DI2C_CLOCK=1000000
+#ifndef I2C_CLOCK
+#define I2C_CLOCK 400000ul
+#endif
+
+// Polled, register level TWI master. Unlike Wire it has no transfer buffer, so a
+// transaction can be as long as the slave allows.
+class TWI
+{
+    public:
+        enum class Direction : uint8_t
+        {
+            Write = 0u,
+            Read = 1u
+        };
+
+        static void begin(uint32_t frequency);
+
+        // Sends a start (or repeated start) and the slave address; false if the slave did not acknowledge
+        static bool start(uint8_t address, Direction direction);
+        // False if the slave did not acknowledge the byte
+        static bool write(uint8_t data);
+        static bool write(const char* data, uint32_t size);
+        // Set last on the final byte so the slave releases the bus
+        static uint8_t read(bool last);
+        static void stop();
+};
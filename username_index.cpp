@@ -0,0 +1,86 @@
+#include "username_index.h"
+
+#include "inode.h"
+
+UsernameIndex::Entry* UsernameIndex::victim(bool shared)
+{
+    auto* oldest = static_cast<Entry*>(nullptr);
+    for (auto& entry : _entries)
+    {
+        if (entry.inode == 0u)
+            return &entry;
+        if (entry.shared && !shared)
+            continue;
+        // Inline copies go first, then the least recently used
+        if (oldest == nullptr || (oldest->shared && !entry.shared)
+            || (oldest->shared == entry.shared
+                && static_cast<uint16_t>(_clock - entry.last_used) > static_cast<uint16_t>(_clock - oldest->last_used)))
+            oldest = &entry;
+    }
+    return oldest;
+}
+
+const UsernameIndex::Entry* UsernameIndex::find(uint16_t hash)
+{
+    for (auto& entry : _entries)
+    {
+        if (entry.inode != 0u && entry.hash == hash)
+        {
+            entry.last_used = ++_clock;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void UsernameIndex::insert(uint16_t hash, inode_t inode, bool shared)
+{
+    auto* slot = static_cast<Entry*>(nullptr);
+    for (auto& entry : _entries)
+    {
+        if (entry.inode != 0u && entry.hash == hash)
+            slot = &entry;
+    }
+
+    if (slot != nullptr && !shared)
+        return;
+    if (slot == nullptr)
+        slot = victim(shared);
+    if (slot == nullptr)
+        return;
+
+    slot->hash = hash;
+    slot->inode = inode;
+    slot->shared = shared;
+    slot->last_used = ++_clock;
+}
+
+void UsernameIndex::remove(inode_t inode)
+{
+    for (auto& entry : _entries)
+    {
+        if (entry.inode == inode)
+            entry = Entry();
+    }
+}
+
+void UsernameIndex::moved(inode_t source, inode_t destination)
+{
+    for (auto& entry : _entries)
+    {
+        if (entry.inode == source)
+            entry.inode = destination;
+    }
+}
+
+bool UsernameIndex::built() const
+{
+    return _built;
+}
+
+void UsernameIndex::clear(bool built)
+{
+    for (auto& entry : _entries)
+        entry = Entry();
+    _built = built;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "inode.h"
+
+// Override with -DUSERNAME_INDEX_SIZE=n; each entry takes seven bytes of RAM
+#ifndef USERNAME_INDEX_SIZE
+#if defined(__AVR_ATmega1284P__) || defined(__AVR_ATmega1284__)
+#define USERNAME_INDEX_SIZE 32
+#else
+#define USERNAME_INDEX_SIZE 6
+#endif
+#endif
+
+// Where each username lives, by hash: a string table entry, or the header of a record that
+// holds it inline. The index only saves scans; a hash may collide and an inode may since
+// have been moved, freed or reused, so every hit is checked against the device, and a
+// username it misses is at worst stored once more. Table entries are kept in preference to
+// inline copies when it is full, since missing one of those would duplicate the entry.
+class UsernameIndex
+{
+    public:
+        struct Entry
+        {
+            uint16_t hash;
+            inode_t inode;
+            uint16_t last_used;
+            bool shared;
+
+            Entry() : hash(0u), inode(0u), last_used(0u), shared(false) {}
+        };
+
+    private:
+        Entry _entries[USERNAME_INDEX_SIZE];
+        uint16_t _clock;
+        // Cleared on mount; the index is built by the first write that needs it
+        bool _built;
+
+        Entry* victim(bool shared);
+
+    public:
+        UsernameIndex()
+            : _entries(),
+            _clock(0u),
+            _built(false)
+        {}
+
+        // nullptr on a miss
+        const Entry* find(uint16_t hash);
+
+        // An inline copy never displaces a table entry, nor another copy of the same hash
+        void insert(uint16_t hash, inode_t inode, bool shared);
+        void remove(inode_t inode);
+        void moved(inode_t source, inode_t destination);
+
+        bool built() const;
+        // Empties the index, either to be built again or, after a format, as complete
+        void clear(bool built);
+};
@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <type_traits.h>
+#include <utility.h>
 
 template <typename T>
 class vector
@@ -10,20 +11,45 @@ class vector
         typedef T value_type;
         typedef unsigned int size_type;
         typedef std::add_lvalue_reference_t<T> reference;
-        typedef std::add_const_t<reference> const_reference;
+        typedef std::add_lvalue_reference_t<std::add_const_t<T>> const_reference;
         typedef T* iterator;
-        typedef std::add_const_t<iterator> const_iterator;
+        typedef std::add_const_t<T>* const_iterator;
 
     private:
+        static constexpr size_type minimum_capacity = 4u;
+
         T* _data;
         size_type _size;
         size_type _capacity;
 
-        void copy(iterator from_begin, iterator from_end, iterator to_begin)
+        static void move(iterator from_begin, iterator from_end, iterator to_begin)
         {
             iterator out = to_begin;
             for (auto it = from_begin; it != from_end; it++)
-                *out = std::move(*it);
+                *out++ = std::move(*it);
+        }
+
+        size_type next_capacity(size_type required) const
+        {
+            auto capacity = (_capacity < minimum_capacity) ? minimum_capacity : _capacity;
+            while (capacity < required)
+                capacity += capacity / 2u;
+            return capacity;
+        }
+
+        void reallocate(size_type capacity)
+        {
+            auto* new_data = (capacity > 0u) ? new T[capacity] : nullptr;
+            move(begin(), end(), new_data);
+            delete[] _data;
+            _data = new_data;
+            _capacity = capacity;
+        }
+
+        void grow_for(size_type required)
+        {
+            if (required > _capacity)
+                reallocate(next_capacity(required));
         }
 
     public:
@@ -33,36 +59,43 @@ class vector
               _capacity(0u)
         {}
 
-        vector(size_type size)
-        {
-            _data = new T[size];
-            _size = 0u;
-            _capacity = size;
-        }
+        explicit vector(size_type capacity)
+            : _data((capacity > 0u) ? new T[capacity] : nullptr),
+              _size(0u),
+              _capacity(capacity)
+        {}
+
+        vector(const vector&) = delete;
+        vector& operator=(const vector&) = delete;
 
         vector(vector&& other)
+            : _data(other._data),
+              _size(other._size),
+              _capacity(other._capacity)
         {
-            auto* tmp_data = _data;
-            _data = other._data;
-            _size = other._size;
-            _capacity = other._capacity;
-            other._data = tmp_data;
+            other._data = nullptr;
+            other._size = 0u;
+            other._capacity = 0u;
         }
 
         vector& operator=(vector&& other)
         {
-            auto* tmp_data = _data;
+            if (this == &other)
+                return *this;
+
+            delete[] _data;
             _data = other._data;
             _size = other._size;
             _capacity = other._capacity;
-            other._data = tmp_data;
+            other._data = nullptr;
+            other._size = 0u;
+            other._capacity = 0u;
             return *this;
         }
 
         ~vector()
         {
-            if (_data != nullptr)
-                delete[] _data;
+            delete[] _data;
         }
 
         reference operator[](size_type position)
@@ -75,6 +108,36 @@ class vector
             return *(_data + position);
         }
 
+        reference front()
+        {
+            return *_data;
+        }
+
+        const_reference front() const
+        {
+            return *_data;
+        }
+
+        reference back()
+        {
+            return *(_data + _size - 1u);
+        }
+
+        const_reference back() const
+        {
+            return *(_data + _size - 1u);
+        }
+
+        T* data()
+        {
+            return _data;
+        }
+
+        const T* data() const
+        {
+            return _data;
+        }
+
         iterator begin()
         {
             return _data;
@@ -92,17 +155,17 @@ class vector
 
         iterator end()
         {
-            return (_size > 0) ? (_data + _size) : (_data + 1);
+            return _data + _size;
         }
 
         const_iterator end() const
         {
-            return (_size > 0) ? (_data + _size) : (_data + 1);
+            return _data + _size;
         }
 
         const_iterator cend() const
         {
-            return (_size > 0) ? (_data + _size) : (_data + 1);
+            return _data + _size;
         }
 
         bool empty() const
@@ -120,15 +183,17 @@ class vector
             return _capacity;
         }
 
-        void reserve(size_type size)
+        void reserve(size_type capacity)
         {
-            if (_capacity >= size)
+            if (_capacity >= capacity)
                 return;
-            auto* new_data = new T[size];
-            copy(begin(), end(), new_data);
-            delete[] _data;
-            _data = new_data;
-            _capacity = size;
+            reallocate(capacity);
+        }
+
+        void shrink_to_fit()
+        {
+            if (_capacity != _size)
+                reallocate(_size);
         }
 
         void clear()
@@ -141,70 +206,68 @@ class vector
 
         iterator insert(iterator position, T&& value)
         {
-            iterator item = position - 1;
-            *item = std::move(value);
-            return item;
+            auto index = static_cast<size_type>(position - begin());
+            grow_for(_size + 1u);
+
+            for (auto i = _size; i > index; i--)
+                _data[i] = std::move(_data[i - 1u]);
+            _data[index] = std::move(value);
+            _size++;
+            return begin() + index;
         }
 
         template <typename U = T, typename = std::enable_if_t<std::is_copy_constructible_v<U>>>
         iterator insert(iterator position, const T& value)
         {
-            iterator item = position - 1;
-            *item = value;
-            return item;
+            return insert(position, T(value));
         }
 
         template <typename ... TArgs>
         iterator emplace(iterator position, TArgs&&... args)
         {
-            iterator item = position - 1;
-            *item = T(std::move(args)...);
-            return item;
+            return insert(position, T(std::forward<TArgs>(args)...));
+        }
+
+        iterator erase(iterator position)
+        {
+            auto index = static_cast<size_type>(position - begin());
+            move(position + 1, end(), position);
+            _data[--_size] = T();
+            return begin() + index;
         }
 
         void push_back(T&& value)
         {
-            if (++_size >= _capacity)
-                reserve(_size);
-            insert(end(), std::move(value));
+            grow_for(_size + 1u);
+            _data[_size++] = std::move(value);
         }
 
         template <typename U = T, typename = std::enable_if_t<std::is_copy_constructible_v<U>>>
         void push_back(const T& value)
         {
-            if (++_size >= _capacity)
-                reserve(_size);
-            insert(end(), value);
+            grow_for(_size + 1u);
+            _data[_size++] = value;
         }
 
         template <typename ... TArgs>
         reference emplace_back(TArgs&&... args)
         {
-            push_back(T(std::forward<TArgs...>(args...)));
-            return *end();
+            push_back(T(std::forward<TArgs>(args)...));
+            return back();
         }
 
         void pop_back()
         {
-            _size--;
+            _data[--_size] = T();
         }
 
         void resize(size_type count)
         {
-            if (_size == count)
-                return;
-            
-            auto* new_data = new T[count];
-            if (_size > count)
-                copy(begin(), begin() + count, new_data);
-            if (_size < count)
-                copy(begin(), end(), new_data);
-           
-            delete[] _data;
-            _data = new_data;
-           
-            _capacity = count;
-            if (_size > count)
-                _size = count;
+            if (count > _capacity)
+                reallocate(count);
+
+            for (auto i = count; i < _size; i++)
+                _data[i] = T();
+            _size = count;
         }
 };
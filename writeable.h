@@ -1,10 +1,12 @@
 #pragma once
 
+#include "address.h"
+
 class IWriteable
 {
     public:
         virtual ~IWriteable() {};
 
-        virtual void write(unsigned short address, const char* data, unsigned long size) = 0;
+        virtual void write(address_t address, const char* data, unsigned long size) = 0;
 };
 